@@ -9,22 +9,37 @@
  * Copyright (C) Purism SPC 2019
  */
 
+#include <linux/backlight.h>
+#include <linux/completion.h>
 #include <linux/debugfs.h>
 #include <linux/delay.h>
+#include <linux/devm-helpers.h>
 #include <linux/gpio/consumer.h>
+#include <linux/iopoll.h>
+#include <linux/ktime.h>
 #include <linux/media-bus-format.h>
 #include <linux/mod_devicetable.h>
 #include <linux/module.h>
+#include <linux/mutex.h>
 #include <linux/of.h>
+#include <linux/pm_runtime.h>
 #include <linux/regulator/consumer.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+#include <linux/sort.h>
+#include <linux/workqueue.h>
 
 #include <video/display_timing.h>
 #include <video/mipi_display.h>
 
 #include <drm/drm_mipi_dsi.h>
 #include <drm/drm_modes.h>
+#include <drm/drm_of.h>
 #include <drm/drm_panel.h>
 
+#define CREATE_TRACE_POINTS
+#include "panel-sitronix-st7703-trace.h"
+
 #define DRV_NAME "panel-sitronix-st7703"
 
 /* Manufacturer specific Commands send via DSI */
@@ -54,6 +69,164 @@
 #define ST7703_CMD_SETGIP2	 0xEA
 #define ST7703_CMD_UNKNOWN_EF	 0xEF
 
+/* Booster status bit of the DCS power mode, not covered by mipi_display.h */
+#define ST7703_POWER_MODE_BOOSTER BIT(7)
+
+/* DCS power mode of a healthy, enabled panel */
+#define ST7703_POWER_MODE_ENABLED (ST7703_POWER_MODE_BOOSTER |	\
+				   MIPI_DCS_POWER_MODE_SLEEP |	\
+				   MIPI_DCS_POWER_MODE_NORMAL |	\
+				   MIPI_DCS_POWER_MODE_DISPLAY)
+
+/* SETMIPI (0xBA) first parameter, lane count - 1 in the low nibble */
+#define ST7703_MIPI_LANES	 GENMASK(3, 0)
+
+/*
+ * Receiver limit per data lane, and the share of it a mode may use. The
+ * rest is left for packet overhead and the host's burst mode headroom.
+ */
+#define ST7703_LANE_MAX_KBPS	 1000000
+#define ST7703_LANE_LOAD_PCT	 80
+
+/* SETPANEL (0xCC) scan direction bits */
+#define ST7703_PANEL_GS		 BIT(1)	/* gate scan, vertical flip */
+#define ST7703_PANEL_SS		 BIT(2)	/* source scan, horizontal flip */
+#define ST7703_PANEL_BGR	 BIT(3)	/* subpixel order, flips with SS */
+
+/* DCS write control display (0x53) bits */
+#define ST7703_CTRL_BCTRL	 BIT(5)	/* brightness control block on */
+#define ST7703_CTRL_DD		 BIT(3)	/* display dimming */
+#define ST7703_CTRL_BL		 BIT(2)	/* backlight on */
+
+/* Minimum gap after sleep-in/out before the controller accepts commands */
+#define ST7703_SLEEP_CMD_DELAY_US 5000
+#define ST7703_POLL_INTERVAL_US	  2000
+/* Minimum time from sleep-in to the next sleep-out */
+#define ST7703_SLEEP_IN_OUT_MS	  120
+/* Brightness write coalescing, one frame at the slowest mode (30Hz) */
+#define ST7703_BL_COALESCE_MS	  34
+
+/*
+ * Init sequences are packed byte streams. Every record is an opcode, a length
+ * and that many bytes of data:
+ *
+ *   ST7703_DCS(cmd, params...)		DCS write of cmd and params
+ *   ST7703_GENERIC(cmd, params...)	generic write of cmd and params
+ *   ST7703_DELAY(ms)			sleep for ms milliseconds
+ *   ST7703_PATCH(cmd, off, bytes...)	overwrite params of cmd from off
+ *
+ * Patch records only appear in a panel's init_patch stream and let a panel
+ * reuse another panel's sequence with a few bytes changed. Every stream is
+ * terminated by ST7703_SEQ_END.
+ */
+enum st7703_seq_op {
+	ST7703_SEQ_END,
+	ST7703_SEQ_DCS,
+	ST7703_SEQ_GENERIC,
+	ST7703_SEQ_DELAY,
+	ST7703_SEQ_PATCH,
+};
+
+#define ST7703_SEQ_LEN(...) sizeof((const u8[]){ __VA_ARGS__ })
+#define ST7703_DCS(cmd, ...) \
+	ST7703_SEQ_DCS, 1 + ST7703_SEQ_LEN(__VA_ARGS__), cmd, __VA_ARGS__
+#define ST7703_GENERIC(cmd, ...) \
+	ST7703_SEQ_GENERIC, 1 + ST7703_SEQ_LEN(__VA_ARGS__), cmd, __VA_ARGS__
+#define ST7703_DELAY(ms) ST7703_SEQ_DELAY, 1, ms
+#define ST7703_PATCH(cmd, off, ...) \
+	ST7703_SEQ_PATCH, 2 + ST7703_SEQ_LEN(__VA_ARGS__), cmd, off, __VA_ARGS__
+
+/* Longest record payload: SETGIP1 command byte plus 63 parameters */
+#define ST7703_SEQ_MAX_LEN 64
+
+/* Probe time ST7703_PATCH() records from DT options, 5 bytes each */
+#define ST7703_DT_PATCH_MAX 4
+
+/* SETGAMMA parameters: 17 reference points each for both polarities */
+#define ST7703_GAMMA_LEN 34
+
+/* Distinct commands with parameters written between two resets */
+#define ST7703_MAX_REGS 32
+
+/* Number of most recent samples kept per phase for the latency statistics */
+#define ST7703_LAT_SAMPLES 128
+
+enum st7703_phase {
+	ST7703_PHASE_SUPPLIES,
+	ST7703_PHASE_RESET,
+	ST7703_PHASE_INIT,
+	ST7703_PHASE_SLEEP_OUT,
+	ST7703_PHASE_DISPLAY_ON,
+	ST7703_PHASE_DISPLAY_OFF,
+	ST7703_PHASE_SLEEP_IN,
+	ST7703_PHASE_PREPARE,
+	ST7703_PHASE_ENABLE,
+	ST7703_PHASE_DISABLE,
+	ST7703_PHASE_UNPREPARE,
+	ST7703_NUM_PHASES,
+};
+
+static const char * const st7703_phase_names[ST7703_NUM_PHASES] = {
+	[ST7703_PHASE_SUPPLIES]	   = "supplies",
+	[ST7703_PHASE_RESET]	   = "reset",
+	[ST7703_PHASE_INIT]	   = "init",
+	[ST7703_PHASE_SLEEP_OUT]   = "sleep-out",
+	[ST7703_PHASE_DISPLAY_ON]  = "display-on",
+	[ST7703_PHASE_DISPLAY_OFF] = "display-off",
+	[ST7703_PHASE_SLEEP_IN]	   = "sleep-in",
+	[ST7703_PHASE_PREPARE]	   = "prepare",
+	[ST7703_PHASE_ENABLE]	   = "enable",
+	[ST7703_PHASE_DISABLE]	   = "disable",
+	[ST7703_PHASE_UNPREPARE]   = "unprepare",
+};
+
+struct st7703_lat_stats {
+	u32 samples[ST7703_LAT_SAMPLES];	/* ring of durations in us */
+	unsigned int count;			/* samples recorded in total */
+};
+
+enum st7703_power_state {
+	ST7703_POWER_OFF,	/* supplies off, reset asserted */
+	ST7703_POWER_SLEEP,	/* supplies on, controller in DCS sleep-in */
+	ST7703_POWER_ON,	/* init sequence sent, ready for sleep-out */
+	ST7703_POWER_ENABLED,	/* sleep-out, display on */
+	ST7703_POWER_IDLE,	/* enabled, runtime suspended in DCS idle mode */
+	ST7703_POWER_DOZE,	/* enabled, runtime suspended in DCS sleep-in */
+	ST7703_NUM_POWER_STATES
+};
+
+static const char * const st7703_power_names[ST7703_NUM_POWER_STATES] = {
+	[ST7703_POWER_OFF]     = "off",
+	[ST7703_POWER_SLEEP]   = "sleep",
+	[ST7703_POWER_ON]      = "prepared",
+	[ST7703_POWER_ENABLED] = "enabled",
+	[ST7703_POWER_IDLE]    = "idle",
+	[ST7703_POWER_DOZE]    = "doze",
+};
+
+/* Content adaptive backlight control modes, values are DCS 0x55 arguments */
+enum st7703_cabc_mode {
+	ST7703_CABC_OFF,
+	ST7703_CABC_UI,
+	ST7703_CABC_STILL,
+	ST7703_CABC_MOVING,
+};
+
+static const char * const st7703_cabc_names[] = {
+	[ST7703_CABC_OFF]    = "off",
+	[ST7703_CABC_UI]     = "ui",
+	[ST7703_CABC_STILL]  = "still",
+	[ST7703_CABC_MOVING] = "moving",
+};
+
+/* Parameters last written with a command, i.e. the register contents */
+struct st7703_reg {
+	u8 cmd;
+	u8 len;
+	bool dcs;		/* written as DCS rather than generic write */
+	u8 val[ST7703_SEQ_MAX_LEN - 1];
+};
+
 struct st7703 {
 	struct device *dev;
 	struct drm_panel panel;
@@ -61,17 +234,125 @@ struct st7703 {
 	struct regulator *vcc;
 	struct regulator *iovcc;
 
+	/* Keep supplies up in unprepare and only enter DCS sleep */
+	bool light_sleep;
+	/* Poll the DCS power mode instead of sleeping out the full delays */
+	bool poll_ready;
+	/* Send init and power commands in HS mode, cleared on HS failure */
+	bool hs_cmds;
+	/* Check for a panel lit by firmware at the first prepare */
+	bool keep_boot_on;
+	/* Set when it was, the next enable then skips sleep-out/display-on */
+	bool boot_enabled;
+
+	/* Supplies and reset started from probe, init left to prepare */
+	bool async_power;
+	bool reset_done;	/* supplies on and reset done, init pending */
+	ktime_t sleep_in_time;	/* when sleep-in was last sent */
+	struct work_struct power_work;
+	struct completion power_done;
+
+	/* Serialises power state changes with runtime feature updates */
+	struct mutex lock;
+	enum st7703_power_state power_state;
+	/* Residency accounting, updated by st7703_set_state() */
+	ktime_t state_since;
+	u64 residency_us[ST7703_NUM_POWER_STATES];
+	u64 state_enters[ST7703_NUM_POWER_STATES];
+	u32 power_uw[ST7703_NUM_POWER_STATES];
+	/* Requested CABC mode and the one last written to the controller */
+	enum st7703_cabc_mode cabc_mode;
+	enum st7703_cabc_mode cabc_hw;
+
+	/* DCS brightness control, only when the DT names no backlight */
+	struct backlight_device *dcs_bl;
+	struct delayed_work bl_work;
+	int bl_hw;		/* last written brightness, -1 after reset */
+
+	/* Runtime PM idle steps, disabled when idle_ms is 0 */
+	u32 idle_ms;		/* inactivity before DCS idle mode */
+	u32 doze_ms;		/* time in idle mode before sleep-in, 0 = never */
+	struct delayed_work doze_work;
+
+	/* ESD watchdog, disabled when esd_period_ms is 0 */
+	u32 esd_period_ms;
+	struct delayed_work esd_work;
+	int esd_diag;		/* diagnostic result after enable, -1 = unknown */
+	u64 esd_checks;
+	u64 esd_failures;
+	u64 esd_recoveries;
+	s64 esd_last_us;	/* duration of the last recovery */
+	s64 esd_max_us;
+
+	/* Scratch buffer for sending init sequence records */
+	u8 seq_buf[ST7703_SEQ_MAX_LEN];
+
+	/* Shadow of the registers written since the last reset */
+	struct st7703_reg regs[ST7703_MAX_REGS];
+	unsigned int num_regs;
+
+	/* User gamma table as an ST7703_PATCH() list, NULL for the default */
+	const u8 *gamma_override;
+	u8 gamma_patch[4 + ST7703_GAMMA_LEN + 1];
+	/* Scan direction and lane count changes, fixed at probe */
+	u8 dt_patch[ST7703_DT_PATCH_MAX * 5 + 1];
+	unsigned int dt_patch_len;
+
+	/* Per-phase latencies, protected by lat_lock */
+	struct st7703_lat_stats lat[ST7703_NUM_PHASES];
+	struct mutex lat_lock;
+
 	struct dentry *debugfs;
 	const struct st7703_panel_desc *desc;
 	enum drm_panel_orientation orientation;
 };
 
+/*
+ * Power sequencing delays in ms. In poll mode the sleep-out, display-on and
+ * sleep-in values become upper bounds for polling the DCS power mode.
+ */
+struct st7703_timings {
+	unsigned int reset;		/* reset release to first command */
+	unsigned int sleep_out;		/* sleep-out to display-on */
+	unsigned int display_on;	/* display-on to first usable frame */
+	unsigned int display_off;	/* display-off to video stop, >= 1 frame */
+	unsigned int sleep_in;		/* sleep-in to supplies off */
+};
+
 struct st7703_panel_desc {
-	const struct drm_display_mode *mode;
+	/* Validated modes, the first one is the native, preferred mode */
+	const struct drm_display_mode *modes;
+	unsigned int num_modes;
 	unsigned int lanes;
-	unsigned long mode_flags;
+	unsigned long mode_flags;	/* video mode only, there is no frame memory */
+	/* Default pixel format and BIT() mask of all supported ones */
 	enum mipi_dsi_pixel_format format;
-	void (*init_sequence)(struct mipi_dsi_multi_context *dsi_ctx);
+	unsigned int formats;
+	struct st7703_timings timings;
+	/* Optional power draw estimate per state in uW, 0 if unknown */
+	u32 power_uw[ST7703_NUM_POWER_STATES];
+	const u8 *init_seq;
+	/* Optional ST7703_PATCH() records applied on top of init_seq */
+	const u8 *init_patch;
+};
+
+static const struct st7703_format {
+	const char *name;	/* sitronix,pixel-format value */
+	u32 bus_format;
+	u8 dcs_format;		/* COLMOD (0x3A) pixel format */
+} st7703_formats[] = {
+	[MIPI_DSI_FMT_RGB888] = {
+		"rgb888", MEDIA_BUS_FMT_RGB888_1X24, MIPI_DCS_PIXEL_FMT_24BIT,
+	},
+	[MIPI_DSI_FMT_RGB666] = {
+		"rgb666", MEDIA_BUS_FMT_RGB666_1X24_CPADHI, MIPI_DCS_PIXEL_FMT_18BIT,
+	},
+	[MIPI_DSI_FMT_RGB666_PACKED] = {
+		"rgb666-packed", MEDIA_BUS_FMT_RGB666_1X18, MIPI_DCS_PIXEL_FMT_18BIT,
+	},
+	[MIPI_DSI_FMT_RGB565] = {
+		"rgb565", MEDIA_BUS_FMT_RGB565_1X16, MIPI_DCS_PIXEL_FMT_16BIT,
+	},
 };
 
 static inline struct st7703 *panel_to_st7703(struct drm_panel *panel)
@@ -79,62 +360,59 @@ static inline struct st7703 *panel_to_st7703(struct drm_panel *panel)
 	return container_of(panel, struct st7703, panel);
 }
 
-static void jh057n_init_sequence(struct mipi_dsi_multi_context *dsi_ctx)
-{
-	/*
-	 * Init sequence was supplied by the panel vendor. Most of the commands
-	 * resemble the ST7703 but the number of parameters often don't match
-	 * so it's likely a clone.
-	 */
-	mipi_dsi_generic_write_seq_multi(dsi_ctx, ST7703_CMD_SETEXTC,
-					 0xF1, 0x12, 0x83);
-	mipi_dsi_generic_write_seq_multi(dsi_ctx, ST7703_CMD_SETRGBIF,
-					 0x10, 0x10, 0x05, 0x05, 0x03, 0xFF, 0x00, 0x00,
-					 0x00, 0x00);
-	mipi_dsi_generic_write_seq_multi(dsi_ctx, ST7703_CMD_SETSCR,
-					 0x73, 0x73, 0x50, 0x50, 0x00, 0x00, 0x08, 0x70,
-					 0x00);
-	mipi_dsi_generic_write_seq_multi(dsi_ctx, ST7703_CMD_SETVDC, 0x4E);
-	mipi_dsi_generic_write_seq_multi(dsi_ctx, ST7703_CMD_SETPANEL, 0x0B);
-	mipi_dsi_generic_write_seq_multi(dsi_ctx, ST7703_CMD_SETCYC, 0x80);
-	mipi_dsi_generic_write_seq_multi(dsi_ctx, ST7703_CMD_SETDISP, 0xF0, 0x12,
-					 0x30);
-	mipi_dsi_generic_write_seq_multi(dsi_ctx, ST7703_CMD_SETEQ,
-					 0x07, 0x07, 0x0B, 0x0B, 0x03, 0x0B, 0x00, 0x00,
-					 0x00, 0x00, 0xFF, 0x00, 0xC0, 0x10);
-	mipi_dsi_generic_write_seq_multi(dsi_ctx, ST7703_CMD_SETBGP, 0x08, 0x08);
-	mipi_dsi_msleep(dsi_ctx, 20);
-
-	mipi_dsi_generic_write_seq_multi(dsi_ctx, ST7703_CMD_SETVCOM, 0x3F, 0x3F);
-	mipi_dsi_generic_write_seq_multi(dsi_ctx, ST7703_CMD_UNKNOWN_BF, 0x02, 0x11,
-					 0x00);
-	mipi_dsi_generic_write_seq_multi(dsi_ctx, ST7703_CMD_SETGIP1,
-					 0x82, 0x10, 0x06, 0x05, 0x9E, 0x0A, 0xA5, 0x12,
-					 0x31, 0x23, 0x37, 0x83, 0x04, 0xBC, 0x27, 0x38,
-					 0x0C, 0x00, 0x03, 0x00, 0x00, 0x00, 0x0C, 0x00,
-					 0x03, 0x00, 0x00, 0x00, 0x75, 0x75, 0x31, 0x88,
-					 0x88, 0x88, 0x88, 0x88, 0x88, 0x13, 0x88, 0x64,
-					 0x64, 0x20, 0x88, 0x88, 0x88, 0x88, 0x88, 0x88,
-					 0x02, 0x88, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-					 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00);
-	mipi_dsi_generic_write_seq_multi(dsi_ctx, ST7703_CMD_SETGIP2,
-					 0x02, 0x21, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-					 0x00, 0x00, 0x00, 0x00, 0x02, 0x46, 0x02, 0x88,
-					 0x88, 0x88, 0x88, 0x88, 0x88, 0x64, 0x88, 0x13,
-					 0x57, 0x13, 0x88, 0x88, 0x88, 0x88, 0x88, 0x88,
-					 0x75, 0x88, 0x23, 0x14, 0x00, 0x00, 0x02, 0x00,
-					 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-					 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x30, 0x0A,
-					 0xA5, 0x00, 0x00, 0x00, 0x00);
+/*
+ * Init sequence was supplied by the panel vendor. Most of the commands
+ * resemble the ST7703 but the number of parameters often don't match
+ * so it's likely a clone.
+ */
+static const u8 jh057n_init_seq[] = {
+	ST7703_GENERIC(ST7703_CMD_SETEXTC, 0xF1, 0x12, 0x83),
+	ST7703_GENERIC(ST7703_CMD_SETRGBIF,
+		       0x10, 0x10, 0x05, 0x05, 0x03, 0xFF, 0x00, 0x00,
+		       0x00, 0x00),
+	ST7703_GENERIC(ST7703_CMD_SETSCR,
+		       0x73, 0x73, 0x50, 0x50, 0x00, 0x00, 0x08, 0x70,
+		       0x00),
+	ST7703_GENERIC(ST7703_CMD_SETVDC, 0x4E),
+	ST7703_GENERIC(ST7703_CMD_SETPANEL, 0x0B),
+	ST7703_GENERIC(ST7703_CMD_SETCYC, 0x80),
+	ST7703_GENERIC(ST7703_CMD_SETDISP, 0xF0, 0x12, 0x30),
+	ST7703_GENERIC(ST7703_CMD_SETEQ,
+		       0x07, 0x07, 0x0B, 0x0B, 0x03, 0x0B, 0x00, 0x00,
+		       0x00, 0x00, 0xFF, 0x00, 0xC0, 0x10),
+	ST7703_GENERIC(ST7703_CMD_SETBGP, 0x08, 0x08),
+	ST7703_DELAY(20),
+
+	ST7703_GENERIC(ST7703_CMD_SETVCOM, 0x3F, 0x3F),
+	ST7703_GENERIC(ST7703_CMD_UNKNOWN_BF, 0x02, 0x11, 0x00),
+	ST7703_GENERIC(ST7703_CMD_SETGIP1,
+		       0x82, 0x10, 0x06, 0x05, 0x9E, 0x0A, 0xA5, 0x12,
+		       0x31, 0x23, 0x37, 0x83, 0x04, 0xBC, 0x27, 0x38,
+		       0x0C, 0x00, 0x03, 0x00, 0x00, 0x00, 0x0C, 0x00,
+		       0x03, 0x00, 0x00, 0x00, 0x75, 0x75, 0x31, 0x88,
+		       0x88, 0x88, 0x88, 0x88, 0x88, 0x13, 0x88, 0x64,
+		       0x64, 0x20, 0x88, 0x88, 0x88, 0x88, 0x88, 0x88,
+		       0x02, 0x88, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+		       0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00),
+	ST7703_GENERIC(ST7703_CMD_SETGIP2,
+		       0x02, 0x21, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+		       0x00, 0x00, 0x00, 0x00, 0x02, 0x46, 0x02, 0x88,
+		       0x88, 0x88, 0x88, 0x88, 0x88, 0x64, 0x88, 0x13,
+		       0x57, 0x13, 0x88, 0x88, 0x88, 0x88, 0x88, 0x88,
+		       0x75, 0x88, 0x23, 0x14, 0x00, 0x00, 0x02, 0x00,
+		       0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+		       0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x30, 0x0A,
+		       0xA5, 0x00, 0x00, 0x00, 0x00),
 
 	/* Adjust the gamma characteristics of the panel. */
-	mipi_dsi_dcs_write_seq_multi(dsi_ctx, ST7703_CMD_SETGAMMA,
-				     0x00, 0x09, 0x0D, 0x23, 0x27, 0x3C, 0x41, 0x35,
-				     0x07, 0x0D, 0x0E, 0x12, 0x13, 0x10, 0x12, 0x12,
-				     0x18, 0x00, 0x09, 0x0D, 0x23, 0x27, 0x3C, 0x41,
-				     0x35, 0x07, 0x0D, 0x0E, 0x12, 0x13, 0x10, 0x12,
-				     0x12, 0x18);
-}
+	ST7703_DCS(ST7703_CMD_SETGAMMA,
+		   0x00, 0x09, 0x0D, 0x23, 0x27, 0x3C, 0x41, 0x35,
+		   0x07, 0x0D, 0x0E, 0x12, 0x13, 0x10, 0x12, 0x12,
+		   0x18, 0x00, 0x09, 0x0D, 0x23, 0x27, 0x3C, 0x41,
+		   0x35, 0x07, 0x0D, 0x0E, 0x12, 0x13, 0x10, 0x12,
+		   0x12, 0x18),
+	ST7703_SEQ_END,
+};
 
 static const struct drm_display_mode jh057n00900_mode = {
 	.hdisplay    = 720,
@@ -152,388 +430,1799 @@ static const struct drm_display_mode jh057n00900_mode = {
 };
 
 static const struct st7703_panel_desc jh057n00900_panel_desc = {
-	.mode = &jh057n00900_mode,
+	.modes = &jh057n00900_mode,
+	.num_modes = 1,
 	.lanes = 4,
 	.mode_flags = MIPI_DSI_MODE_VIDEO |
 		MIPI_DSI_MODE_VIDEO_BURST | MIPI_DSI_MODE_VIDEO_SYNC_PULSE,
 	.format = MIPI_DSI_FMT_RGB888,
-	.init_sequence = jh057n_init_sequence,
-};
-
-static void xbd599_init_sequence(struct mipi_dsi_multi_context *dsi_ctx)
-{
-	/*
-	 * Init sequence was supplied by the panel vendor.
-	 */
-
-	/* Magic sequence to unlock user commands below. */
-	mipi_dsi_dcs_write_seq_multi(dsi_ctx, ST7703_CMD_SETEXTC, 0xF1, 0x12, 0x83);
-
-	mipi_dsi_dcs_write_seq_multi(dsi_ctx, ST7703_CMD_SETMIPI,
-				     0x33, /* VC_main = 0, Lane_Number = 3 (4 lanes) */
-				     0x81, /* DSI_LDO_SEL = 1.7V, RTERM = 90 Ohm */
-				     0x05, /* IHSRX = x6 (Low High Speed driving ability) */
-				     0xF9, /* TX_CLK_SEL = fDSICLK/16 */
-				     0x0E, /* HFP_OSC (min. HFP number in DSI mode) */
-				     0x0E, /* HBP_OSC (min. HBP number in DSI mode) */
-				     /* The rest is undocumented in ST7703 datasheet */
-				     0x20, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-				     0x44, 0x25, 0x00, 0x90, 0x0a, 0x00, 0x00, 0x01,
-				     0x4f, 0x01, 0x00, 0x00, 0x37);
-	mipi_dsi_dcs_write_seq_multi(dsi_ctx, ST7703_CMD_SETPOWER_EXT, 0x25, 0x22,
-				     0xf0, 0x63);
-	mipi_dsi_dcs_write_seq_multi(dsi_ctx, ST7703_CMD_UNKNOWN_BF, 0x02, 0x11, 0x00);
-	mipi_dsi_dcs_write_seq_multi(dsi_ctx, ST7703_CMD_SETRGBIF, 0x10, 0x10, 0x28,
-				     0x28, 0x03, 0xff, 0x00, 0x00, 0x00, 0x00);
-	mipi_dsi_dcs_write_seq_multi(dsi_ctx, ST7703_CMD_SETSCR, 0x73, 0x73, 0x50, 0x50,
-				     0x00, 0x00, 0x12, 0x70, 0x00);
-	mipi_dsi_dcs_write_seq_multi(dsi_ctx, ST7703_CMD_SETVDC, 0x46);
-	mipi_dsi_dcs_write_seq_multi(dsi_ctx, ST7703_CMD_SETPANEL, 0x0b);
-	mipi_dsi_dcs_write_seq_multi(dsi_ctx, ST7703_CMD_SETCYC, 0x80);
-	mipi_dsi_dcs_write_seq_multi(dsi_ctx, ST7703_CMD_SETDISP, 0x3c, 0x12, 0x30);
-	mipi_dsi_dcs_write_seq_multi(dsi_ctx, ST7703_CMD_SETEQ, 0x07, 0x07, 0x0b, 0x0b,
-				     0x03, 0x0b, 0x00, 0x00, 0x00, 0x00, 0xff, 0x00,
-				     0xc0, 0x10);
-	mipi_dsi_dcs_write_seq_multi(dsi_ctx, ST7703_CMD_SETPOWER, 0x36, 0x00, 0x32,
-				     0x32, 0x77, 0xf1, 0xcc, 0xcc, 0x77, 0x77, 0x33,
-				     0x33);
-	mipi_dsi_dcs_write_seq_multi(dsi_ctx, ST7703_CMD_SETBGP, 0x0a, 0x0a);
-	mipi_dsi_dcs_write_seq_multi(dsi_ctx, ST7703_CMD_SETVCOM, 0xb2, 0xb2);
-	mipi_dsi_dcs_write_seq_multi(dsi_ctx, ST7703_CMD_SETGIP1,
-				     0xc8, 0x10, 0x0a, 0x10, 0x0f, 0xa1, 0x80, 0x12,
-				     0x31, 0x23, 0x47, 0x86, 0xa1, 0x80, 0x47, 0x08,
-				     0x00, 0x00, 0x0d, 0x00, 0x00, 0x00, 0x00, 0x00,
-				     0x0d, 0x00, 0x00, 0x00, 0x48, 0x02, 0x8b, 0xaf,
-				     0x46, 0x02, 0x88, 0x88, 0x88, 0x88, 0x88, 0x48,
-				     0x13, 0x8b, 0xaf, 0x57, 0x13, 0x88, 0x88, 0x88,
-				     0x88, 0x88, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00,
-				     0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00);
-	mipi_dsi_dcs_write_seq_multi(dsi_ctx, ST7703_CMD_SETGIP2,
-				     0x96, 0x12, 0x01, 0x01, 0x01, 0x78, 0x02, 0x00,
-				     0x00, 0x00, 0x00, 0x00, 0x4f, 0x31, 0x8b, 0xa8,
-				     0x31, 0x75, 0x88, 0x88, 0x88, 0x88, 0x88, 0x4f,
-				     0x20, 0x8b, 0xa8, 0x20, 0x64, 0x88, 0x88, 0x88,
-				     0x88, 0x88, 0x23, 0x00, 0x00, 0x01, 0x02, 0x00,
-				     0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-				     0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x40, 0xa1,
-				     0x80, 0x00, 0x00, 0x00, 0x00);
-	mipi_dsi_dcs_write_seq_multi(dsi_ctx, ST7703_CMD_SETGAMMA, 0x00, 0x0a, 0x0f,
-				     0x29, 0x3b, 0x3f, 0x42, 0x39, 0x06, 0x0d, 0x10,
-				     0x13, 0x15, 0x14, 0x15, 0x10, 0x17, 0x00, 0x0a,
-				     0x0f, 0x29, 0x3b, 0x3f, 0x42, 0x39, 0x06, 0x0d,
-				     0x10, 0x13, 0x15, 0x14, 0x15, 0x10, 0x17);
-}
-
-static const struct drm_display_mode xbd599_mode = {
-	.hdisplay    = 720,
-	.hsync_start = 720 + 40,
-	.hsync_end   = 720 + 40 + 40,
-	.htotal	     = 720 + 40 + 40 + 40,
-	.vdisplay    = 1440,
-	.vsync_start = 1440 + 18,
-	.vsync_end   = 1440 + 18 + 10,
-	.vtotal	     = 1440 + 18 + 10 + 17,
-	.clock	     = 69000,
-	.flags	     = DRM_MODE_FLAG_NHSYNC | DRM_MODE_FLAG_NVSYNC,
-	.width_mm    = 68,
-	.height_mm   = 136,
-};
-
-static const struct st7703_panel_desc xbd599_desc = {
-	.mode = &xbd599_mode,
-	.lanes = 4,
-	.mode_flags = MIPI_DSI_MODE_VIDEO | MIPI_DSI_MODE_VIDEO_SYNC_PULSE,
-	.format = MIPI_DSI_FMT_RGB888,
-	.init_sequence = xbd599_init_sequence,
+	.formats = BIT(MIPI_DSI_FMT_RGB888),
+	.timings = {
+		/* Vendor values, the clone needs the long sleep-out delay */
+		.reset = 20,
+		.sleep_out = 250,
+		.display_on = 50,
+		.display_off = 20,
+		.sleep_in = 120,
+	},
+	.init_seq = jh057n_init_seq,
 };
 
-static void gx040hd_init_sequence(struct mipi_dsi_multi_context *dsi_ctx)
-{
-	/*
-	 * Init sequence for GX040HD-30MB-A1 4.0" 720x720 IPS LCD panel
-	 * based on ST7703 controller. Init sequence extracted from vendor BSP.
-	 */
-
+/*
+ * Init sequence for GX040HD-30MB-A1 4.0" 720x720 IPS LCD panel
+ * based on ST7703 controller. Init sequence extracted from vendor BSP.
+ */
+static const u8 gx040hd_init_seq[] = {
 	/* Magic sequence to unlock user commands */
-	mipi_dsi_dcs_write_seq_multi(dsi_ctx, ST7703_CMD_SETEXTC, 0xF1, 0x12, 0x83);
+	ST7703_DCS(ST7703_CMD_SETEXTC, 0xF1, 0x12, 0x83),
 
 	/* Set MIPI DSI configuration */
-	mipi_dsi_dcs_write_seq_multi(dsi_ctx, ST7703_CMD_SETMIPI,
-				     0x33, /* 4Lane */
-				     0x81, 0x05, 0xF9, 0x0E, 0x0E, 0x20, 0x00, 0x00, 
-				     0x00, 0x00, 0x00, 0x00, 0x00, 0x44, 0x25, 0x00, 
-				     0x90, 0x0A, 0x00, 0x00, 0x01, 0x4F, 0x01, 0x00, 
-				     0x00, 0x37);
+	ST7703_DCS(ST7703_CMD_SETMIPI,
+		   0x33, /* 4Lane */
+		   0x81, 0x05, 0xF9, 0x0E, 0x0E, 0x20, 0x00, 0x00,
+		   0x00, 0x00, 0x00, 0x00, 0x00, 0x44, 0x25, 0x00,
+		   0x90, 0x0A, 0x00, 0x00, 0x01, 0x4F, 0x01, 0x00,
+		   0x00, 0x37),
 
 	/* Set Power Control extension */
-	mipi_dsi_dcs_write_seq_multi(dsi_ctx, ST7703_CMD_SETPOWER_EXT, 0x25, 0x22,
-				     0xF0, 0x63);
+	ST7703_DCS(ST7703_CMD_SETPOWER_EXT, 0x25, 0x22, 0xF0, 0x63),
 
 	/* Set unknown BF register */
-	mipi_dsi_dcs_write_seq_multi(dsi_ctx, ST7703_CMD_UNKNOWN_BF, 0x02, 0x11, 0x00);
+	ST7703_DCS(ST7703_CMD_UNKNOWN_BF, 0x02, 0x11, 0x00),
 
 	/* Set RGB interface */
-	mipi_dsi_dcs_write_seq_multi(dsi_ctx, ST7703_CMD_SETRGBIF, 0x10, 0x10, 0x28,
-				     0x28, 0x03, 0xFF, 0x00, 0x00, 0x00, 0x00);
+	ST7703_DCS(ST7703_CMD_SETRGBIF, 0x10, 0x10, 0x28,
+		   0x28, 0x03, 0xFF, 0x00, 0x00, 0x00, 0x00),
 
 	/* Set source control register */
-	mipi_dsi_dcs_write_seq_multi(dsi_ctx, ST7703_CMD_SETSCR, 0x73, 0x73, 0x50, 0x50,
-				     0x00, 0x00, 0x12, 0x70, 0x00);
+	ST7703_DCS(ST7703_CMD_SETSCR, 0x73, 0x73, 0x50, 0x50,
+		   0x00, 0x00, 0x12, 0x70, 0x00),
 
 	/* Set VDC voltage */
-	mipi_dsi_dcs_write_seq_multi(dsi_ctx, ST7703_CMD_SETVDC, 0x46);
+	ST7703_DCS(ST7703_CMD_SETVDC, 0x46),
 
 	/* Set panel control */
-	mipi_dsi_dcs_write_seq_multi(dsi_ctx, ST7703_CMD_SETPANEL, 0x0B);
+	ST7703_DCS(ST7703_CMD_SETPANEL, 0x0B),
 
 	/* Set panel inversion */
-	mipi_dsi_dcs_write_seq_multi(dsi_ctx, ST7703_CMD_SETCYC, 0x80);
+	ST7703_DCS(ST7703_CMD_SETCYC, 0x80),
 
 	/* Set display resolution and timing */
-	mipi_dsi_dcs_write_seq_multi(dsi_ctx, ST7703_CMD_SETDISP, 0x3C, 0x12, 0x30);
+	ST7703_DCS(ST7703_CMD_SETDISP, 0x3C, 0x12, 0x30),
 
 	/* Set EQ timing control */
-	mipi_dsi_dcs_write_seq_multi(dsi_ctx, ST7703_CMD_SETEQ, 0x07, 0x07, 0x0B, 0x0B,
-				     0x03, 0x0B, 0x00, 0x00, 0x00, 0x00, 0xFF, 0x00,
-				     0xC0, 0x10);
+	ST7703_DCS(ST7703_CMD_SETEQ, 0x07, 0x07, 0x0B, 0x0B,
+		   0x03, 0x0B, 0x00, 0x00, 0x00, 0x00, 0xFF, 0x00,
+		   0xC0, 0x10),
 
 	/* Set power control */
-	mipi_dsi_dcs_write_seq_multi(dsi_ctx, ST7703_CMD_SETPOWER, 0x36, 0x00, 0x32,
-				     0x32, 0x77, 0xF1, 0xCC, 0xCC, 0x77, 0x77, 0x33,
-				     0x33);
+	ST7703_DCS(ST7703_CMD_SETPOWER, 0x36, 0x00, 0x32,
+		   0x32, 0x77, 0xF1, 0xCC, 0xCC, 0x77, 0x77, 0x33,
+		   0x33),
 
 	/* Set BGP voltage */
-	mipi_dsi_dcs_write_seq_multi(dsi_ctx, ST7703_CMD_SETBGP, 0x0A, 0x0A);
+	ST7703_DCS(ST7703_CMD_SETBGP, 0x0A, 0x0A),
 
 	/* Set VCOM voltage */
-	mipi_dsi_dcs_write_seq_multi(dsi_ctx, ST7703_CMD_SETVCOM, 0xB2, 0xB2);
+	ST7703_DCS(ST7703_CMD_SETVCOM, 0xB2, 0xB2),
 
 	/* Set GIP1 timing control */
-	mipi_dsi_dcs_write_seq_multi(dsi_ctx, ST7703_CMD_SETGIP1,
-				     0xC8, 0x10, 0x0A, 0x10, 0x0F, 0xA1, 0x80, 0x12,
-				     0x31, 0x23, 0x47, 0x86, 0xA1, 0x80, 0x47, 0x08,
-				     0x00, 0x00, 0x0D, 0x00, 0x00, 0x00, 0x00, 0x00,
-				     0x0D, 0x00, 0x00, 0x00, 0x48, 0x02, 0x8B, 0xAF,
-				     0x46, 0x02, 0x88, 0x88, 0x88, 0x88, 0x88, 0x48,
-				     0x13, 0x8B, 0xAF, 0x57, 0x13, 0x88, 0x88, 0x88,
-				     0x88, 0x88, 0x88, 0x88, 0x88, 0x88, 0x88, 0x88,
-				     0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00);
+	ST7703_DCS(ST7703_CMD_SETGIP1,
+		   0xC8, 0x10, 0x0A, 0x10, 0x0F, 0xA1, 0x80, 0x12,
+		   0x31, 0x23, 0x47, 0x86, 0xA1, 0x80, 0x47, 0x08,
+		   0x00, 0x00, 0x0D, 0x00, 0x00, 0x00, 0x00, 0x00,
+		   0x0D, 0x00, 0x00, 0x00, 0x48, 0x02, 0x8B, 0xAF,
+		   0x46, 0x02, 0x88, 0x88, 0x88, 0x88, 0x88, 0x48,
+		   0x13, 0x8B, 0xAF, 0x57, 0x13, 0x88, 0x88, 0x88,
+		   0x88, 0x88, 0x88, 0x88, 0x88, 0x88, 0x88, 0x88,
+		   0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00),
 
 	/* Set GIP2 timing control */
-	mipi_dsi_dcs_write_seq_multi(dsi_ctx, ST7703_CMD_SETGIP2,
-				     0x96, 0x12, 0x01, 0x01, 0x01, 0x78, 0x02, 0x00,
-				     0x00, 0x00, 0x00, 0x00, 0x4F, 0x31, 0x8B, 0xA8,
-				     0x31, 0x75, 0x88, 0x88, 0x88, 0x88, 0x88, 0x4F,
-				     0x20, 0x8B, 0xA8, 0x20, 0x64, 0x88, 0x88, 0x88,
-				     0x88, 0x88, 0x23, 0x00, 0x00, 0x01, 0x02, 0x00,
-				     0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-				     0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x40, 0xA1,
-				     0x80, 0x00, 0x00, 0x00, 0x00);
+	ST7703_DCS(ST7703_CMD_SETGIP2,
+		   0x96, 0x12, 0x01, 0x01, 0x01, 0x78, 0x02, 0x00,
+		   0x00, 0x00, 0x00, 0x00, 0x4F, 0x31, 0x8B, 0xA8,
+		   0x31, 0x75, 0x88, 0x88, 0x88, 0x88, 0x88, 0x4F,
+		   0x20, 0x8B, 0xA8, 0x20, 0x64, 0x88, 0x88, 0x88,
+		   0x88, 0x88, 0x23, 0x00, 0x00, 0x01, 0x02, 0x00,
+		   0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+		   0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x40, 0xA1,
+		   0x80, 0x00, 0x00, 0x00, 0x00),
 
 	/* Set gamma correction */
-	mipi_dsi_dcs_write_seq_multi(dsi_ctx, ST7703_CMD_SETGAMMA,
-				     0x00, 0x0A, 0x0F, 0x29, 0x3B, 0x3F, 0x42, 0x39,
-				     0x06, 0x0D, 0x10, 0x13, 0x15, 0x14, 0x15, 0x10,
-				     0x17, 0x00, 0x0A, 0x0F, 0x29, 0x3B, 0x3F, 0x42,
-				     0x39, 0x06, 0x0D, 0x10, 0x13, 0x15, 0x14, 0x15,
-				     0x10, 0x17);
+	ST7703_DCS(ST7703_CMD_SETGAMMA,
+		   0x00, 0x0A, 0x0F, 0x29, 0x3B, 0x3F, 0x42, 0x39,
+		   0x06, 0x0D, 0x10, 0x13, 0x15, 0x14, 0x15, 0x10,
+		   0x17, 0x00, 0x0A, 0x0F, 0x29, 0x3B, 0x3F, 0x42,
+		   0x39, 0x06, 0x0D, 0x10, 0x13, 0x15, 0x14, 0x15,
+		   0x10, 0x17),
+	ST7703_SEQ_END,
+};
+
+/*
+ * The lower refresh rates keep the vendor porches and only scale the pixel
+ * clock, so the init sequence is the same for all of them.
+ */
+#define GX040HD_MODE(_clock) {						\
+	.hdisplay    = 720,						\
+	.hsync_start = 720 + 80,  /* HFP */				\
+	.hsync_end   = 720 + 80 + 20,  /* HSA */			\
+	.htotal	     = 720 + 80 + 20 + 80,  /* HBP */			\
+	.vdisplay    = 720,						\
+	.vsync_start = 720 + 30,  /* VFP */				\
+	.vsync_end   = 720 + 30 + 4,   /* VSA */			\
+	.vtotal	     = 720 + 30 + 4 + 12,   /* VBP */			\
+	.clock	     = _clock,						\
+	.flags	     = DRM_MODE_FLAG_NHSYNC | DRM_MODE_FLAG_NVSYNC,	\
+	.width_mm    = 89,  /* 89.6mm according to datasheet */		\
+	.height_mm   = 89,  /* 89.6mm according to datasheet */		\
 }
 
-static const struct drm_display_mode gx040hd_mode = {
-	.hdisplay    = 720,
-	.hsync_start = 720 + 80,  /* HFP */
-	.hsync_end   = 720 + 80 + 20,  /* HSA */
-	.htotal	     = 720 + 80 + 20 + 80,  /* HBP */
-	.vdisplay    = 720,
-	.vsync_start = 720 + 30,  /* VFP */
-	.vsync_end   = 720 + 30 + 4,   /* VSA */
-	.vtotal	     = 720 + 30 + 4 + 12,   /* VBP */
-	.clock	     = 41400,  /* 41.4MHz */
-	.flags	     = DRM_MODE_FLAG_NHSYNC | DRM_MODE_FLAG_NVSYNC,
-	.width_mm    = 89,  /* 89.6mm according to datasheet */
-	.height_mm   = 89,  /* 89.6mm according to datasheet */
+static const struct drm_display_mode gx040hd_modes[] = {
+	GX040HD_MODE(41400),	/* 60Hz, 41.4MHz */
+	GX040HD_MODE(34500),	/* 50Hz */
+	GX040HD_MODE(27600),	/* 40Hz */
+	GX040HD_MODE(20700),	/* 30Hz */
 };
 
 static const struct st7703_panel_desc gx040hd_desc = {
-	.mode = &gx040hd_mode,
+	.modes = gx040hd_modes,
+	.num_modes = ARRAY_SIZE(gx040hd_modes),
 	.lanes = 4,
 	.mode_flags = MIPI_DSI_MODE_VIDEO | MIPI_DSI_MODE_VIDEO_BURST |
 		      MIPI_DSI_MODE_NO_EOT_PACKET | MIPI_DSI_MODE_LPM,
 	.format = MIPI_DSI_FMT_RGB888,
-	.init_sequence = gx040hd_init_sequence,
+	.formats = BIT(MIPI_DSI_FMT_RGB888) | BIT(MIPI_DSI_FMT_RGB666) |
+		   BIT(MIPI_DSI_FMT_RGB666_PACKED) | BIT(MIPI_DSI_FMT_RGB565),
+	.timings = {
+		.reset = 10,
+		.sleep_out = 250,	/* vendor value */
+		.display_on = 20,
+		.display_off = 34,	/* one frame at 30Hz */
+		.sleep_in = 120,
+	},
+	.init_seq = gx040hd_init_seq,
 };
 
-static int st7703_enable(struct drm_panel *panel)
-{
-	struct st7703 *ctx = panel_to_st7703(panel);
-	struct mipi_dsi_device *dsi = to_mipi_dsi_device(ctx->dev);
-	struct mipi_dsi_multi_context dsi_ctx = { .dsi = dsi };
+/*
+ * Init sequence was supplied by the panel vendor. It is the same as the
+ * GX040HD one apart from the GIP1 COS mapping.
+ */
+static const u8 xbd599_init_patch[] = {
+	ST7703_PATCH(ST7703_CMD_SETGIP1, 50, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00),
+	ST7703_SEQ_END,
+};
 
-	mipi_dsi_dcs_exit_sleep_mode_multi(&dsi_ctx);
-	mipi_dsi_msleep(&dsi_ctx, 250);
+static const struct drm_display_mode xbd599_mode = {
+	.hdisplay    = 720,
+	.hsync_start = 720 + 40,
+	.hsync_end   = 720 + 40 + 40,
+	.htotal	     = 720 + 40 + 40 + 40,
+	.vdisplay    = 1440,
+	.vsync_start = 1440 + 18,
+	.vsync_end   = 1440 + 18 + 10,
+	.vtotal	     = 1440 + 18 + 10 + 17,
+	.clock	     = 69000,
+	.flags	     = DRM_MODE_FLAG_NHSYNC | DRM_MODE_FLAG_NVSYNC,
+	.width_mm    = 68,
+	.height_mm   = 136,
+};
 
-	mipi_dsi_dcs_set_display_on_multi(&dsi_ctx);
-	mipi_dsi_msleep(&dsi_ctx, 50);
+static const struct st7703_panel_desc xbd599_desc = {
+	.modes = &xbd599_mode,
+	.num_modes = 1,
+	.lanes = 4,
+	.mode_flags = MIPI_DSI_MODE_VIDEO | MIPI_DSI_MODE_VIDEO_SYNC_PULSE,
+	.format = MIPI_DSI_FMT_RGB888,
+	.formats = BIT(MIPI_DSI_FMT_RGB888),
+	.timings = {
+		.reset = 10,
+		.sleep_out = 120,
+		.display_on = 20,
+		.display_off = 20,
+		.sleep_in = 120,
+	},
+	.init_seq = gx040hd_init_seq,
+	.init_patch = xbd599_init_patch,
+};
 
-	return dsi_ctx.accum_err;
+/* Move to @state, charging the time since the last change to the old one */
+static void st7703_set_state(struct st7703 *ctx, enum st7703_power_state state)
+{
+	ktime_t now = ktime_get();
+
+	ctx->residency_us[ctx->power_state] += ktime_us_delta(now, ctx->state_since);
+	ctx->state_since = now;
+	if (state != ctx->power_state)
+		ctx->state_enters[state]++;
+	ctx->power_state = state;
 }
 
-static int st7703_disable(struct drm_panel *panel)
+/* Trace a completed phase and add its duration to the statistics */
+static void st7703_record(struct st7703 *ctx, enum st7703_phase phase,
+			  ktime_t start, int err)
 {
-	struct st7703 *ctx = panel_to_st7703(panel);
-	struct mipi_dsi_device *dsi = to_mipi_dsi_device(ctx->dev);
-	struct mipi_dsi_multi_context dsi_ctx = { .dsi = dsi };
+	s64 us = ktime_us_delta(ktime_get(), start);
+	struct st7703_lat_stats *lat = &ctx->lat[phase];
 
-	mipi_dsi_dcs_set_display_off_multi(&dsi_ctx);
-	mipi_dsi_msleep(&dsi_ctx, 120);
+	trace_st7703_phase(ctx->dev, st7703_phase_names[phase], us, err);
 
-	return dsi_ctx.accum_err;
+	mutex_lock(&ctx->lat_lock);
+	lat->samples[lat->count % ST7703_LAT_SAMPLES] = min_t(s64, us, U32_MAX);
+	lat->count++;
+	mutex_unlock(&ctx->lat_lock);
 }
 
-static int st7703_unprepare(struct drm_panel *panel)
+/*
+ * Wait for the DCS power mode bits in @mask to read back as @val, for at most
+ * @timeout_ms. Without poll mode, or when the controller does not confirm the
+ * state in time, this degrades to sleeping out the full delay.
+ */
+static void st7703_wait_power_mode(struct st7703 *ctx,
+				   struct mipi_dsi_multi_context *dsi_ctx,
+				   u8 mask, u8 val, unsigned int timeout_ms,
+				   const char *what)
 {
-	struct st7703 *ctx = panel_to_st7703(panel);
-	struct mipi_dsi_device *dsi = to_mipi_dsi_device(ctx->dev);
-	struct mipi_dsi_multi_context dsi_ctx = { .dsi = dsi };
+	ktime_t start = ktime_get();
+	s64 elapsed_ms;
+	u8 mode = 0;
+	int ret, err;
 
-	mipi_dsi_dcs_enter_sleep_mode_multi(&dsi_ctx);
-	mipi_dsi_msleep(&dsi_ctx, 120);
+	if (dsi_ctx->accum_err)
+		return;
 
-	gpiod_set_value_cansleep(ctx->reset_gpio, 1);
-	regulator_disable(ctx->iovcc);
-	regulator_disable(ctx->vcc);
+	if (!ctx->poll_ready) {
+		msleep(timeout_ms);
+		return;
+	}
 
-	return dsi_ctx.accum_err;
+	usleep_range(ST7703_SLEEP_CMD_DELAY_US, ST7703_SLEEP_CMD_DELAY_US + 1000);
+	ret = read_poll_timeout(mipi_dsi_dcs_get_power_mode, err,
+				err < 0 || (mode & mask) == val,
+				ST7703_POLL_INTERVAL_US, timeout_ms * USEC_PER_MSEC,
+				false, dsi_ctx->dsi, &mode);
+	if (ret || err < 0) {
+		elapsed_ms = ktime_ms_delta(ktime_get(), start);
+		if (elapsed_ms < timeout_ms)
+			msleep(timeout_ms - elapsed_ms);
+	}
+
+	dev_dbg(ctx->dev, "%s took %lld us (power mode 0x%02x%s)\n", what,
+		ktime_us_delta(ktime_get(), start), mode,
+		ret || err < 0 ? ", not confirmed" : "");
 }
 
-static int st7703_prepare(struct drm_panel *panel)
+/*
+ * Run a group of commands, in HS mode if enabled. The first HS failure turns
+ * HS commands off for good and the group is retried in LP mode.
+ */
+static int st7703_run_cmds(struct st7703 *ctx, int (*cmds)(struct st7703 *ctx),
+			   const char *what)
 {
-	struct st7703 *ctx = panel_to_st7703(panel);
 	struct mipi_dsi_device *dsi = to_mipi_dsi_device(ctx->dev);
-	struct mipi_dsi_multi_context dsi_ctx = { .dsi = dsi };
+	unsigned long mode_flags = dsi->mode_flags;
+	ktime_t start = ktime_get();
+	bool hs;
 	int ret;
 
-	dev_dbg(ctx->dev, "Resetting the panel\n");
-	ret = regulator_enable(ctx->vcc);
-	if (ret < 0) {
-		dev_err(ctx->dev, "Failed to enable vcc supply: %d\n", ret);
-		return ret;
+	if (ctx->hs_cmds)
+		dsi->mode_flags &= ~MIPI_DSI_MODE_LPM;
+	hs = !(dsi->mode_flags & MIPI_DSI_MODE_LPM);
+
+	ret = cmds(ctx);
+	dsi->mode_flags = mode_flags;
+
+	if (ret && ctx->hs_cmds) {
+		dev_warn(ctx->dev, "%s failed in HS mode (%d), falling back to LP\n",
+			 what, ret);
+		ctx->hs_cmds = false;
+		hs = !(dsi->mode_flags & MIPI_DSI_MODE_LPM);
+		start = ktime_get();
+		ret = cmds(ctx);
 	}
-	ret = regulator_enable(ctx->iovcc);
-	if (ret < 0) {
-		dev_err(ctx->dev, "Failed to enable iovcc supply: %d\n", ret);
-		goto disable_vcc;
+
+	dev_dbg(ctx->dev, "%s took %lld us in %s mode\n", what,
+		ktime_us_delta(ktime_get(), start), hs ? "HS" : "LP");
+
+	return ret;
+}
+
+/*
+ * Record a successful write in the register shadow. Commands without
+ * parameters, like sleep-out, only change the power mode and are skipped.
+ */
+static void st7703_shadow(struct st7703 *ctx, const u8 *buf, size_t len,
+			  bool dcs)
+{
+	struct st7703_reg *reg;
+	unsigned int i;
+
+	if (len < 2)
+		return;
+
+	for (i = 0; i < ctx->num_regs; i++)
+		if (ctx->regs[i].cmd == buf[0])
+			break;
+	if (i == ctx->num_regs) {
+		if (WARN_ON_ONCE(i == ST7703_MAX_REGS))
+			return;
+		ctx->num_regs++;
 	}
 
-	gpiod_set_value_cansleep(ctx->reset_gpio, 1);
-	usleep_range(20, 40);
-	gpiod_set_value_cansleep(ctx->reset_gpio, 0);
-	msleep(20);
+	reg = &ctx->regs[i];
+	reg->cmd = buf[0];
+	reg->len = len - 1;
+	reg->dcs = dcs;
+	memcpy(reg->val, &buf[1], len - 1);
+}
 
-	ctx->desc->init_sequence(&dsi_ctx);
-	if (dsi_ctx.accum_err)
-		goto disable_iovcc;
+static const struct st7703_reg *st7703_find_reg(struct st7703 *ctx, u8 cmd)
+{
+	unsigned int i;
 
-	dev_dbg(ctx->dev, "Panel init sequence done\n");
-	return 0;
+	for (i = 0; i < ctx->num_regs; i++)
+		if (ctx->regs[i].cmd == cmd)
+			return &ctx->regs[i];
 
-disable_iovcc:
-	regulator_disable(ctx->iovcc);
-disable_vcc:
-	regulator_disable(ctx->vcc);
-	return ret;
+	return NULL;
 }
 
-static const u32 mantix_bus_formats[] = {
-	MEDIA_BUS_FMT_RGB888_1X24,
-};
+/* Read back the parameters of @reg with @cmd, returns the length read */
+static ssize_t st7703_read_reg(struct mipi_dsi_device *dsi,
+			       const struct st7703_reg *reg, u8 cmd, u8 *val)
+{
+	ssize_t ret;
 
-static int st7703_get_modes(struct drm_panel *panel,
-			    struct drm_connector *connector)
+	/* The peripheral returns a single byte unless told otherwise */
+	ret = mipi_dsi_set_maximum_return_packet_size(dsi, reg->len);
+	if (ret < 0)
+		return ret;
+
+	if (reg->dcs || cmd != reg->cmd)
+		return mipi_dsi_dcs_read(dsi, cmd, val, reg->len);
+
+	return mipi_dsi_generic_read(dsi, &cmd, 1, val, reg->len);
+}
+
+static void st7703_write_cabc(struct st7703 *ctx,
+			      struct mipi_dsi_multi_context *dsi_ctx)
 {
-	struct st7703 *ctx = panel_to_st7703(panel);
-	struct drm_display_mode *mode;
+	u8 ctrl[] = { MIPI_DCS_WRITE_CONTROL_DISPLAY,
+		      ST7703_CTRL_BCTRL | ST7703_CTRL_DD | ST7703_CTRL_BL };
+	u8 cabc[] = { MIPI_DCS_WRITE_POWER_SAVE, ctx->cabc_mode };
 
-	mode = drm_mode_duplicate(connector->dev, ctx->desc->mode);
-	if (!mode) {
-		dev_err(ctx->dev, "Failed to add mode %ux%u@%u\n",
-			ctx->desc->mode->hdisplay, ctx->desc->mode->vdisplay,
-			drm_mode_vrefresh(ctx->desc->mode));
-		return -ENOMEM;
-	}
+	if (ctx->cabc_mode == ctx->cabc_hw)
+		return;
 
-	drm_mode_set_name(mode);
+	if (ctx->cabc_mode != ST7703_CABC_OFF)
+		mipi_dsi_dcs_write_buffer_multi(dsi_ctx, ctrl, sizeof(ctrl));
+	mipi_dsi_dcs_write_buffer_multi(dsi_ctx, cabc, sizeof(cabc));
 
-	mode->type = DRM_MODE_TYPE_DRIVER | DRM_MODE_TYPE_PREFERRED;
-	connector->display_info.width_mm = mode->width_mm;
-	connector->display_info.height_mm = mode->height_mm;
-	drm_mode_probed_add(connector, mode);
+	if (dsi_ctx->accum_err)
+		return;
 
-	drm_display_info_set_bus_formats(&connector->display_info,
-					 mantix_bus_formats,
-					 ARRAY_SIZE(mantix_bus_formats));
+	ctx->cabc_hw = ctx->cabc_mode;
+	if (ctx->cabc_mode != ST7703_CABC_OFF)
+		st7703_shadow(ctx, ctrl, sizeof(ctrl), true);
+	st7703_shadow(ctx, cabc, sizeof(cabc), true);
+}
 
-	return 1;
+/*
+ * .enable runs before the backlight core unblanks, when the brightness still
+ * reads as 0. With @enabling set, the level the core is about to restore is
+ * written instead, so the panel does not light up dark.
+ */
+static void st7703_write_brightness(struct st7703 *ctx,
+				    struct mipi_dsi_multi_context *dsi_ctx,
+				    bool enabling)
+{
+	u8 ctrl[] = { MIPI_DCS_WRITE_CONTROL_DISPLAY,
+		      ST7703_CTRL_BCTRL | ST7703_CTRL_DD | ST7703_CTRL_BL };
+	u8 bl[] = { MIPI_DCS_SET_DISPLAY_BRIGHTNESS, 0 };
+	int brightness;
+
+	if (!ctx->dcs_bl)
+		return;
+
+	if (enabling)
+		brightness = ctx->dcs_bl->props.brightness;
+	else
+		brightness = backlight_get_brightness(ctx->dcs_bl);
+	if (brightness == ctx->bl_hw)
+		return;
+
+	/* The brightness register is ignored until BCTRL is set */
+	if (ctx->bl_hw < 0)
+		mipi_dsi_dcs_write_buffer_multi(dsi_ctx, ctrl, sizeof(ctrl));
+	bl[1] = brightness;
+	mipi_dsi_dcs_write_buffer_multi(dsi_ctx, bl, sizeof(bl));
+
+	if (dsi_ctx->accum_err)
+		return;
+
+	if (ctx->bl_hw < 0)
+		st7703_shadow(ctx, ctrl, sizeof(ctrl), true);
+	st7703_shadow(ctx, bl, sizeof(bl), true);
+	ctx->bl_hw = brightness;
 }
 
-static enum drm_panel_orientation st7703_get_orientation(struct drm_panel *panel)
+/*
+ * Polling only shows that sleep-in was accepted, within a few ms, while the
+ * controller keeps powering down for the full delay. Sleep out the rest of
+ * @ms since sleep-in was sent.
+ */
+static void st7703_wait_since_sleep_in(struct st7703 *ctx, unsigned int ms)
 {
-	struct st7703 *st7703 = panel_to_st7703(panel);
+	s64 elapsed_ms = ktime_ms_delta(ktime_get(), ctx->sleep_in_time);
 
-	return st7703->orientation;
+	if (elapsed_ms < ms)
+		msleep(ms - elapsed_ms);
 }
 
-static const struct drm_panel_funcs st7703_drm_funcs = {
-	.disable   = st7703_disable,
-	.unprepare = st7703_unprepare,
-	.prepare   = st7703_prepare,
-	.enable	   = st7703_enable,
-	.get_modes = st7703_get_modes,
-	.get_orientation = st7703_get_orientation,
-};
+/* Light sleep can be left again right after a polled sleep-in */
+static void st7703_wait_sleep_in(struct st7703 *ctx,
+				 struct mipi_dsi_multi_context *dsi_ctx)
+{
+	if (!dsi_ctx->accum_err)
+		st7703_wait_since_sleep_in(ctx, ST7703_SLEEP_IN_OUT_MS);
+}
 
-static int allpixelson_set(void *data, u64 val)
+static int st7703_exit_sleep(struct st7703 *ctx)
 {
-	struct st7703 *ctx = data;
 	struct mipi_dsi_device *dsi = to_mipi_dsi_device(ctx->dev);
-	struct mipi_dsi_multi_context dsi_ctx = {.dsi = dsi};
+	struct mipi_dsi_multi_context dsi_ctx = { .dsi = dsi };
+	const struct st7703_timings *timings = &ctx->desc->timings;
+	/* ESD recovery also gets here, with the backlight already on */
+	bool enabling = ctx->power_state != ST7703_POWER_ENABLED;
+	ktime_t start;
+
+	if (ctx->boot_enabled) {
+		ctx->boot_enabled = false;
+		st7703_write_cabc(ctx, &dsi_ctx);
+		st7703_write_brightness(ctx, &dsi_ctx, enabling);
+		return dsi_ctx.accum_err;
+	}
 
-	dev_dbg(ctx->dev, "Setting all pixels on\n");
-	mipi_dsi_generic_write_seq_multi(&dsi_ctx, ST7703_CMD_ALL_PIXEL_ON);
-	mipi_dsi_msleep(&dsi_ctx, 20);
+	st7703_wait_sleep_in(ctx, &dsi_ctx);
+	start = ktime_get();
+	mipi_dsi_dcs_exit_sleep_mode_multi(&dsi_ctx);
+	st7703_wait_power_mode(ctx, &dsi_ctx,
+			       MIPI_DCS_POWER_MODE_SLEEP | ST7703_POWER_MODE_BOOSTER,
+			       MIPI_DCS_POWER_MODE_SLEEP | ST7703_POWER_MODE_BOOSTER,
+			       timings->sleep_out, "sleep-out");
+	st7703_record(ctx, ST7703_PHASE_SLEEP_OUT, start, dsi_ctx.accum_err);
+
+	/* Only differs from the controller state after a full init */
+	st7703_write_cabc(ctx, &dsi_ctx);
+	st7703_write_brightness(ctx, &dsi_ctx, enabling);
+
+	start = ktime_get();
+	mipi_dsi_dcs_set_display_on_multi(&dsi_ctx);
+	st7703_wait_power_mode(ctx, &dsi_ctx, MIPI_DCS_POWER_MODE_DISPLAY,
+			       MIPI_DCS_POWER_MODE_DISPLAY, timings->display_on,
+			       "display-on");
+	st7703_record(ctx, ST7703_PHASE_DISPLAY_ON, start, dsi_ctx.accum_err);
 
 	return dsi_ctx.accum_err;
 }
 
-DEFINE_SIMPLE_ATTRIBUTE(allpixelson_fops, NULL,
-			allpixelson_set, "%llu\n");
+/*
+ * drm_panel gets no callback per atomic commit, so activity is reported
+ * by enable and by userspace through the "activity" attribute.
+ */
+static void st7703_mark_busy(struct st7703 *ctx)
+{
+	if (!ctx->idle_ms)
+		return;
 
-static void st7703_debugfs_init(struct st7703 *ctx)
+	pm_runtime_get_sync(ctx->dev);
+	pm_runtime_mark_last_busy(ctx->dev);
+	pm_runtime_put_autosuspend(ctx->dev);
+}
+
+static int st7703_enable(struct drm_panel *panel)
 {
-	ctx->debugfs = debugfs_create_dir(DRV_NAME, NULL);
+	struct st7703 *ctx = panel_to_st7703(panel);
+	ktime_t start = ktime_get();
+	int ret;
 
-	debugfs_create_file("allpixelson", 0600, ctx->debugfs, ctx,
-			    &allpixelson_fops);
+	mutex_lock(&ctx->lock);
+	ret = st7703_run_cmds(ctx, st7703_exit_sleep, "Display on");
+	if (!ret) {
+		st7703_set_state(ctx, ST7703_POWER_ENABLED);
+		ctx->esd_diag = -1;
+		if (ctx->esd_period_ms)
+			schedule_delayed_work(&ctx->esd_work,
+					      msecs_to_jiffies(ctx->esd_period_ms));
+	}
+	mutex_unlock(&ctx->lock);
+
+	st7703_record(ctx, ST7703_PHASE_ENABLE, start, ret);
+	st7703_mark_busy(ctx);
+
+	return ret;
 }
 
-static void st7703_debugfs_remove(struct st7703 *ctx)
+static int st7703_display_off(struct st7703 *ctx)
 {
-	debugfs_remove_recursive(ctx->debugfs);
-	ctx->debugfs = NULL;
+	struct mipi_dsi_device *dsi = to_mipi_dsi_device(ctx->dev);
+	struct mipi_dsi_multi_context dsi_ctx = { .dsi = dsi };
+	ktime_t start = ktime_get();
+
+	mipi_dsi_dcs_set_display_off_multi(&dsi_ctx);
+	mipi_dsi_msleep(&dsi_ctx, ctx->desc->timings.display_off);
+	st7703_record(ctx, ST7703_PHASE_DISPLAY_OFF, start, dsi_ctx.accum_err);
+
+	return dsi_ctx.accum_err;
 }
 
-static int st7703_probe(struct mipi_dsi_device *dsi)
+static int st7703_disable(struct drm_panel *panel)
 {
-	struct device *dev = &dsi->dev;
-	struct st7703 *ctx;
+	struct st7703 *ctx = panel_to_st7703(panel);
+	ktime_t start = ktime_get();
 	int ret;
 
-	ctx = devm_kzalloc(dev, sizeof(*ctx), GFP_KERNEL);
-	if (!ctx)
-		return -ENOMEM;
-	
-	drm_panel_init(&ctx->panel, dev, &st7703_drm_funcs,
-		       DRM_MODE_CONNECTOR_DSI);
+	cancel_delayed_work_sync(&ctx->esd_work);
+
+	/* Leave idle mode first, light sleep would otherwise retain it */
+	if (ctx->idle_ms)
+		pm_runtime_get_sync(ctx->dev);
+
+	mutex_lock(&ctx->lock);
+	ret = st7703_run_cmds(ctx, st7703_display_off, "Display off");
+	st7703_set_state(ctx, ST7703_POWER_ON);
+	/* Drop a check the period store armed after the cancel above */
+	cancel_delayed_work(&ctx->esd_work);
+	mutex_unlock(&ctx->lock);
+
+	if (ctx->idle_ms)
+		pm_runtime_put_autosuspend(ctx->dev);
+
+	st7703_record(ctx, ST7703_PHASE_DISABLE, start, ret);
+
+	return ret;
+}
+
+static void st7703_power_off(struct st7703 *ctx)
+{
+	gpiod_set_value_cansleep(ctx->reset_gpio, 1);
+	regulator_disable(ctx->iovcc);
+	regulator_disable(ctx->vcc);
+	ctx->reset_done = false;
+	ctx->num_regs = 0;
+	st7703_set_state(ctx, ST7703_POWER_OFF);
+}
+
+static int st7703_enter_sleep(struct st7703 *ctx)
+{
+	struct mipi_dsi_device *dsi = to_mipi_dsi_device(ctx->dev);
+	struct mipi_dsi_multi_context dsi_ctx = { .dsi = dsi };
+	ktime_t start = ktime_get();
+
+	mipi_dsi_dcs_enter_sleep_mode_multi(&dsi_ctx);
+	ctx->sleep_in_time = ktime_get();
+	st7703_wait_power_mode(ctx, &dsi_ctx,
+			       MIPI_DCS_POWER_MODE_SLEEP | ST7703_POWER_MODE_BOOSTER,
+			       0, ctx->desc->timings.sleep_in, "sleep-in");
+	st7703_record(ctx, ST7703_PHASE_SLEEP_IN, start, dsi_ctx.accum_err);
+
+	return dsi_ctx.accum_err;
+}
+
+static int st7703_unprepare(struct drm_panel *panel)
+{
+	struct st7703 *ctx = panel_to_st7703(panel);
+	ktime_t start = ktime_get();
+	int ret;
+
+	mutex_lock(&ctx->lock);
+	ret = st7703_run_cmds(ctx, st7703_enter_sleep, "Sleep-in");
+
+	/*
+	 * In light sleep the controller keeps its register contents, so the
+	 * next prepare can skip the reset and the init sequence. Only do this
+	 * if sleep-in actually reached the panel.
+	 */
+	if (ctx->light_sleep && !ret) {
+		st7703_set_state(ctx, ST7703_POWER_SLEEP);
+	} else {
+		/* Cutting the supplies early would interrupt the discharge */
+		st7703_wait_since_sleep_in(ctx, ctx->desc->timings.sleep_in);
+		st7703_power_off(ctx);
+	}
+	mutex_unlock(&ctx->lock);
+
+	st7703_record(ctx, ST7703_PHASE_UNPREPARE, start, ret);
+
+	return ret;
+}
+
+/*
+ * Check whether the controller still holds the init sequence light sleep left
+ * it with. The supplies and reset line are owned by us so the registers can
+ * only have been lost through a glitch, but a controller reset that way also
+ * reports sleep-in with the display off. SETEXTC reads back as zeroes after
+ * a reset, so compare it with what init wrote.
+ */
+static bool st7703_sleep_retained(struct st7703 *ctx)
+{
+	struct mipi_dsi_device *dsi = to_mipi_dsi_device(ctx->dev);
+	const struct st7703_reg *reg;
+	u8 val[ST7703_SEQ_MAX_LEN - 1];
+	ssize_t ret;
+
+	reg = st7703_find_reg(ctx, ST7703_CMD_SETEXTC);
+	if (!reg)
+		return false;
+
+	ret = st7703_read_reg(dsi, reg, reg->cmd, val);
+	if (ret < 0) {
+		dev_dbg(ctx->dev, "Failed to read SETEXTC: %zd\n", ret);
+		return false;
+	}
+
+	if (ret != reg->len || memcmp(val, reg->val, reg->len)) {
+		dev_dbg(ctx->dev, "SETEXTC reads %*ph\n", (int)ret, val);
+		return false;
+	}
+
+	return true;
+}
+
+static const u8 *st7703_find_cmd(const u8 *seq, u8 cmd)
+{
+	for (; *seq != ST7703_SEQ_END; seq += 2 + seq[1])
+		if ((seq[0] == ST7703_SEQ_DCS || seq[0] == ST7703_SEQ_GENERIC) &&
+		    seq[2] == cmd)
+			return seq;
+
+	return NULL;
+}
+
+static void st7703_patch_command(const u8 *patch, u8 *buf, size_t len)
+{
+	size_t off, n;
+
+	for (; patch && *patch != ST7703_SEQ_END; patch += 2 + patch[1]) {
+		if (patch[0] != ST7703_SEQ_PATCH || patch[2] != buf[0])
+			continue;
+
+		off = 1 + patch[3];
+		n = patch[1] - 2;
+		if (WARN_ON(off + n > len))
+			continue;
+
+		memcpy(&buf[off], &patch[4], n);
+	}
+}
+
+static void st7703_send_sequence(struct st7703 *ctx,
+				 struct mipi_dsi_multi_context *dsi_ctx,
+				 const u8 *seq, const u8 *patch)
+{
+	u8 *buf = ctx->seq_buf;
+	ktime_t start;
+	u8 op, len;
+
+	for (; *seq != ST7703_SEQ_END; seq += 2 + len) {
+		op = seq[0];
+		len = seq[1];
+
+		switch (op) {
+		case ST7703_SEQ_DELAY:
+			mipi_dsi_msleep(dsi_ctx, seq[2]);
+			break;
+		case ST7703_SEQ_DCS:
+		case ST7703_SEQ_GENERIC:
+			if (WARN_ON(len > sizeof(ctx->seq_buf))) {
+				dsi_ctx->accum_err = -EINVAL;
+				return;
+			}
+
+			memcpy(buf, &seq[2], len);
+			st7703_patch_command(patch, buf, len);
+			st7703_patch_command(ctx->gamma_override, buf, len);
+			st7703_patch_command(ctx->dt_patch, buf, len);
+
+			start = ktime_get();
+			if (op == ST7703_SEQ_DCS)
+				mipi_dsi_dcs_write_buffer_multi(dsi_ctx, buf, len);
+			else
+				mipi_dsi_generic_write_multi(dsi_ctx, buf, len);
+			trace_st7703_cmd(ctx->dev, buf[0], len,
+					 ktime_us_delta(ktime_get(), start),
+					 dsi_ctx->accum_err);
+			if (!dsi_ctx->accum_err)
+				st7703_shadow(ctx, buf, len, op == ST7703_SEQ_DCS);
+			break;
+		default:
+			WARN_ON(1);
+			dsi_ctx->accum_err = -EINVAL;
+			return;
+		}
+	}
+}
+
+static void st7703_reset(struct st7703 *ctx)
+{
+	ktime_t start = ktime_get();
+
+	gpiod_set_value_cansleep(ctx->reset_gpio, 1);
+	usleep_range(20, 40);
+	gpiod_set_value_cansleep(ctx->reset_gpio, 0);
+	msleep(ctx->desc->timings.reset);
+	st7703_record(ctx, ST7703_PHASE_RESET, start, 0);
+	ctx->cabc_hw = ST7703_CABC_OFF;
+	ctx->bl_hw = -1;
+	ctx->num_regs = 0;
+}
+
+static int st7703_init(struct st7703 *ctx)
+{
+	struct mipi_dsi_device *dsi = to_mipi_dsi_device(ctx->dev);
+	struct mipi_dsi_multi_context dsi_ctx = { .dsi = dsi };
+	ktime_t start = ktime_get();
+
+	st7703_send_sequence(ctx, &dsi_ctx, ctx->desc->init_seq,
+			     ctx->desc->init_patch);
+
+	/* The controller comes out of reset in 24 bpp */
+	if (dsi->format != MIPI_DSI_FMT_RGB888) {
+		u8 colmod = st7703_formats[dsi->format].dcs_format;
+		u8 buf[] = { MIPI_DCS_SET_PIXEL_FORMAT, colmod << 4 | colmod };
+
+		mipi_dsi_dcs_write_buffer_multi(&dsi_ctx, buf, sizeof(buf));
+		if (!dsi_ctx.accum_err)
+			st7703_shadow(ctx, buf, sizeof(buf), true);
+	}
+	st7703_record(ctx, ST7703_PHASE_INIT, start, dsi_ctx.accum_err);
+
+	return dsi_ctx.accum_err;
+}
+
+static int st7703_reset_and_init(struct st7703 *ctx)
+{
+	st7703_reset(ctx);
+
+	return st7703_init(ctx);
+}
+
+/*
+ * Init after the async power-up. The first attempt relies on the reset pulse
+ * the power work sent, an LP retry after an HS failure resets again.
+ */
+static int st7703_init_after_reset(struct st7703 *ctx)
+{
+	if (!ctx->reset_done)
+		st7703_reset(ctx);
+	ctx->reset_done = false;
+
+	return st7703_init(ctx);
+}
+
+static int st7703_enable_supplies(struct st7703 *ctx)
+{
+	ktime_t start = ktime_get();
+	int ret;
+
+	ret = regulator_enable(ctx->vcc);
+	if (ret < 0) {
+		dev_err(ctx->dev, "Failed to enable vcc supply: %d\n", ret);
+		goto out;
+	}
+	ret = regulator_enable(ctx->iovcc);
+	if (ret < 0) {
+		dev_err(ctx->dev, "Failed to enable iovcc supply: %d\n", ret);
+		regulator_disable(ctx->vcc);
+	}
+
+out:
+	st7703_record(ctx, ST7703_PHASE_SUPPLIES, start, ret);
+	return ret;
+}
+
+/*
+ * Firmware may have initialized the panel for a splash screen. Taking it
+ * over as is avoids a visible blank and the init delays at boot. Only the
+ * first prepare after probe checks, later ones always find it off.
+ */
+static bool st7703_take_over(struct st7703 *ctx)
+{
+	struct mipi_dsi_device *dsi = to_mipi_dsi_device(ctx->dev);
+	u8 mode;
+	int ret;
+
+	if (!ctx->keep_boot_on)
+		return false;
+	ctx->keep_boot_on = false;
+
+	/* A gamma table stored before the first prepare needs the init too */
+	if (ctx->gamma_override) {
+		dev_info(ctx->dev, "Gamma table changed, initializing\n");
+		return false;
+	}
+
+	ret = mipi_dsi_dcs_get_power_mode(dsi, &mode);
+	if (ret < 0 || mode != ST7703_POWER_MODE_ENABLED) {
+		dev_info(ctx->dev, "Panel not enabled by firmware, initializing\n");
+		return false;
+	}
+
+	dev_info(ctx->dev, "Keeping panel enabled by firmware\n");
+	ctx->boot_enabled = true;
+	return true;
+}
+
+static int st7703_power_on(struct st7703 *ctx)
+{
+	int (*init)(struct st7703 *ctx) = st7703_reset_and_init;
+	int ret;
+
+	if (ctx->reset_done) {
+		dev_dbg(ctx->dev, "Panel powered up at probe, sending init\n");
+		init = st7703_init_after_reset;
+	} else if (ctx->power_state == ST7703_POWER_SLEEP) {
+		if (st7703_sleep_retained(ctx)) {
+			dev_dbg(ctx->dev, "Resuming from light sleep\n");
+			st7703_set_state(ctx, ST7703_POWER_ON);
+			return 0;
+		}
+
+		/* Supplies are still on, only redo reset and init */
+		dev_dbg(ctx->dev, "Light sleep state lost, resetting the panel\n");
+	} else {
+		ret = st7703_enable_supplies(ctx);
+		if (ret < 0)
+			return ret;
+
+		/* The supplies were already on, enabling only took a reference */
+		if (st7703_take_over(ctx)) {
+			st7703_set_state(ctx, ST7703_POWER_ON);
+			return 0;
+		}
+		dev_dbg(ctx->dev, "Resetting the panel\n");
+	}
+
+	ret = st7703_run_cmds(ctx, init, "Init sequence");
+	if (ret) {
+		dev_err(ctx->dev, "Failed to send init sequence: %d\n", ret);
+		st7703_power_off(ctx);
+		return ret;
+	}
+
+	st7703_set_state(ctx, ST7703_POWER_ON);
+	dev_dbg(ctx->dev, "Panel init sequence done\n");
+	return 0;
+}
+
+/*
+ * Ramp the supplies and reset the controller while the DSI host is still
+ * binding. The init sequence needs a working link, so prepare sends it.
+ */
+static void st7703_power_work(struct work_struct *work)
+{
+	struct st7703 *ctx = container_of(work, struct st7703, power_work);
+	struct regulator_bulk_data supplies[] = {
+		{ .supply = "vcc", .consumer = ctx->vcc },
+		{ .supply = "iovcc", .consumer = ctx->iovcc },
+	};
+	ktime_t start = ktime_get();
+	int ret;
+
+	mutex_lock(&ctx->lock);
+	if (ctx->power_state == ST7703_POWER_OFF) {
+		/* Unlike st7703_enable_supplies(), ramp both in parallel */
+		ret = regulator_bulk_enable(ARRAY_SIZE(supplies), supplies);
+		st7703_record(ctx, ST7703_PHASE_SUPPLIES, start, ret);
+		if (!ret) {
+			st7703_reset(ctx);
+			ctx->reset_done = true;
+			/* Out of reset the controller is powered and in sleep-in */
+			st7703_set_state(ctx, ST7703_POWER_SLEEP);
+		} else {
+			dev_warn(ctx->dev, "Async power-up failed: %d\n", ret);
+		}
+	}
+	mutex_unlock(&ctx->lock);
+
+	complete_all(&ctx->power_done);
+}
+
+static int st7703_prepare(struct drm_panel *panel)
+{
+	struct st7703 *ctx = panel_to_st7703(panel);
+	ktime_t start = ktime_get();
+	int ret;
+
+	if (ctx->async_power)
+		wait_for_completion(&ctx->power_done);
+
+	mutex_lock(&ctx->lock);
+	ret = st7703_power_on(ctx);
+	mutex_unlock(&ctx->lock);
+
+	st7703_record(ctx, ST7703_PHASE_PREPARE, start, ret);
+
+	return ret;
+}
+
+static int st7703_get_modes(struct drm_panel *panel,
+			    struct drm_connector *connector)
+{
+	struct st7703 *ctx = panel_to_st7703(panel);
+	struct mipi_dsi_device *dsi = to_mipi_dsi_device(ctx->dev);
+	const struct drm_display_mode *m;
+	struct drm_display_mode *mode;
+	unsigned int i;
+
+	for (i = 0; i < ctx->desc->num_modes; i++) {
+		m = &ctx->desc->modes[i];
+
+		mode = drm_mode_duplicate(connector->dev, m);
+		if (!mode) {
+			dev_err(ctx->dev, "Failed to add mode %ux%u@%u\n",
+				m->hdisplay, m->vdisplay, drm_mode_vrefresh(m));
+			return -ENOMEM;
+		}
+
+		drm_mode_set_name(mode);
+
+		mode->type = DRM_MODE_TYPE_DRIVER;
+		if (i == 0)
+			mode->type |= DRM_MODE_TYPE_PREFERRED;
+		drm_mode_probed_add(connector, mode);
+	}
+
+	connector->display_info.width_mm = ctx->desc->modes[0].width_mm;
+	connector->display_info.height_mm = ctx->desc->modes[0].height_mm;
+
+	drm_display_info_set_bus_formats(&connector->display_info,
+					 &st7703_formats[dsi->format].bus_format, 1);
+
+	return ctx->desc->num_modes;
+}
+
+static enum drm_panel_orientation st7703_get_orientation(struct drm_panel *panel)
+{
+	struct st7703 *st7703 = panel_to_st7703(panel);
+
+	return st7703->orientation;
+}
+
+static const struct drm_panel_funcs st7703_drm_funcs = {
+	.disable   = st7703_disable,
+	.unprepare = st7703_unprepare,
+	.prepare   = st7703_prepare,
+	.enable	   = st7703_enable,
+	.get_modes = st7703_get_modes,
+	.get_orientation = st7703_get_orientation,
+};
+
+static int st7703_enter_idle(struct st7703 *ctx)
+{
+	struct mipi_dsi_multi_context dsi_ctx = { .dsi = to_mipi_dsi_device(ctx->dev) };
+
+	mipi_dsi_dcs_write_seq_multi(&dsi_ctx, MIPI_DCS_ENTER_IDLE_MODE);
+
+	return dsi_ctx.accum_err;
+}
+
+static int st7703_exit_idle(struct st7703 *ctx)
+{
+	struct mipi_dsi_multi_context dsi_ctx = { .dsi = to_mipi_dsi_device(ctx->dev) };
+	ktime_t start;
+
+	/* Display on is retained across sleep-in, only sleep-out is needed */
+	if (ctx->power_state == ST7703_POWER_DOZE) {
+		st7703_wait_sleep_in(ctx, &dsi_ctx);
+		start = ktime_get();
+		mipi_dsi_dcs_exit_sleep_mode_multi(&dsi_ctx);
+		st7703_wait_power_mode(ctx, &dsi_ctx,
+				       MIPI_DCS_POWER_MODE_SLEEP | ST7703_POWER_MODE_BOOSTER,
+				       MIPI_DCS_POWER_MODE_SLEEP | ST7703_POWER_MODE_BOOSTER,
+				       ctx->desc->timings.sleep_out, "sleep-out");
+		st7703_record(ctx, ST7703_PHASE_SLEEP_OUT, start, dsi_ctx.accum_err);
+	}
+
+	mipi_dsi_dcs_write_seq_multi(&dsi_ctx, MIPI_DCS_EXIT_IDLE_MODE);
+
+	/* Updates made while idle were deferred */
+	st7703_write_cabc(ctx, &dsi_ctx);
+	st7703_write_brightness(ctx, &dsi_ctx, false);
+
+	return dsi_ctx.accum_err;
+}
+
+static void st7703_doze_work(struct work_struct *work)
+{
+	struct st7703 *ctx = container_of(to_delayed_work(work), struct st7703,
+					  doze_work);
+
+	mutex_lock(&ctx->lock);
+	if (ctx->power_state == ST7703_POWER_IDLE &&
+	    !st7703_run_cmds(ctx, st7703_enter_sleep, "Sleep-in"))
+		st7703_set_state(ctx, ST7703_POWER_DOZE);
+	mutex_unlock(&ctx->lock);
+}
+
+static int st7703_runtime_suspend(struct device *dev)
+{
+	struct st7703 *ctx = dev_get_drvdata(dev);
+
+	mutex_lock(&ctx->lock);
+	if (ctx->power_state == ST7703_POWER_ENABLED &&
+	    !st7703_run_cmds(ctx, st7703_enter_idle, "Idle mode")) {
+		st7703_set_state(ctx, ST7703_POWER_IDLE);
+		if (ctx->doze_ms)
+			schedule_delayed_work(&ctx->doze_work,
+					      msecs_to_jiffies(ctx->doze_ms));
+	}
+	mutex_unlock(&ctx->lock);
+
+	/* A failed step leaves the panel on, which is not worth an error */
+	return 0;
+}
+
+static int st7703_runtime_resume(struct device *dev)
+{
+	struct st7703 *ctx = dev_get_drvdata(dev);
+
+	cancel_delayed_work_sync(&ctx->doze_work);
+
+	mutex_lock(&ctx->lock);
+	if ((ctx->power_state == ST7703_POWER_IDLE ||
+	     ctx->power_state == ST7703_POWER_DOZE) &&
+	    !st7703_run_cmds(ctx, st7703_exit_idle, "Normal mode"))
+		st7703_set_state(ctx, ST7703_POWER_ENABLED);
+	mutex_unlock(&ctx->lock);
+
+	return 0;
+}
+
+static const struct dev_pm_ops st7703_pm_ops = {
+	RUNTIME_PM_OPS(st7703_runtime_suspend, st7703_runtime_resume, NULL)
+};
+
+static void st7703_runtime_allow(void *data)
+{
+	pm_runtime_allow(data);
+}
+
+static int st7703_runtime_pm_init(struct st7703 *ctx)
+{
+	int ret;
+
+	ret = devm_delayed_work_autocancel(ctx->dev, &ctx->doze_work,
+					   st7703_doze_work);
+	if (ret)
+		return ret;
+
+	pm_runtime_set_autosuspend_delay(ctx->dev, ctx->idle_ms);
+	pm_runtime_use_autosuspend(ctx->dev);
+
+	ret = devm_pm_runtime_enable(ctx->dev);
+	if (ret)
+		return ret;
+
+	/*
+	 * Without activity reports from userspace the panel would drop to 8
+	 * colours under a live picture, so idle entry stays off until DT or
+	 * power/control opts in. Both live in the DSI device and outlive the
+	 * driver, so set them either way and undo a forbid on unbind.
+	 */
+	if (of_property_read_bool(ctx->dev->of_node, "sitronix,auto-idle")) {
+		pm_runtime_allow(ctx->dev);
+		return 0;
+	}
+
+	pm_runtime_forbid(ctx->dev);
+
+	return devm_add_action_or_reset(ctx->dev, st7703_runtime_allow, ctx->dev);
+}
+
+static bool st7703_esd_check(struct st7703 *ctx)
+{
+	struct mipi_dsi_device *dsi = to_mipi_dsi_device(ctx->dev);
+	u8 mode = 0, diag;
+	int ret;
+
+	ctx->esd_checks++;
+
+	ret = mipi_dsi_dcs_get_power_mode(dsi, &mode);
+	if (ret < 0 || mode != ST7703_POWER_MODE_ENABLED) {
+		dev_warn(ctx->dev, "ESD check: power mode %#x (%d)\n", mode, ret);
+		return false;
+	}
+
+	/*
+	 * The meaning of the self-diagnostic bits is not documented for this
+	 * controller, so only a change since enable is treated as a fault.
+	 */
+	ret = mipi_dsi_dcs_read(dsi, MIPI_DCS_GET_DIAGNOSTIC_RESULT,
+				&diag, sizeof(diag));
+	if (ret != sizeof(diag)) {
+		dev_warn(ctx->dev, "ESD check: diagnostic read failed (%d)\n", ret);
+		return false;
+	}
+	if (ctx->esd_diag < 0)
+		ctx->esd_diag = diag;
+	if (diag != ctx->esd_diag) {
+		dev_warn(ctx->dev, "ESD check: diagnostic result %#x, was %#x\n",
+			 diag, ctx->esd_diag);
+		return false;
+	}
+
+	return true;
+}
+
+static void st7703_esd_recover(struct st7703 *ctx)
+{
+	ktime_t start = ktime_get();
+	int ret;
+
+	/* Supplies stay on, the reset pulse clears the controller */
+	ret = st7703_run_cmds(ctx, st7703_reset_and_init, "Init sequence");
+	if (!ret)
+		ret = st7703_run_cmds(ctx, st7703_exit_sleep, "Display on");
+	if (ret) {
+		dev_err(ctx->dev, "ESD recovery failed: %d\n", ret);
+		return;
+	}
+
+	ctx->esd_diag = -1;
+	ctx->esd_recoveries++;
+	ctx->esd_last_us = ktime_us_delta(ktime_get(), start);
+	ctx->esd_max_us = max(ctx->esd_max_us, ctx->esd_last_us);
+	dev_info(ctx->dev, "Recovered from ESD fault in %lldus\n", ctx->esd_last_us);
+}
+
+/* The watchdog runs from enable to disable, called with the lock held */
+static bool st7703_esd_armed(struct st7703 *ctx)
+{
+	switch (ctx->power_state) {
+	case ST7703_POWER_ENABLED:
+	case ST7703_POWER_IDLE:
+	case ST7703_POWER_DOZE:
+		return ctx->esd_period_ms;
+	default:
+		return false;
+	}
+}
+
+static void st7703_esd_work(struct work_struct *work)
+{
+	struct st7703 *ctx = container_of(to_delayed_work(work), struct st7703,
+					  esd_work);
+
+	mutex_lock(&ctx->lock);
+	/* Skipped while runtime suspended, rescheduled until disable */
+	if (ctx->power_state == ST7703_POWER_ENABLED && !st7703_esd_check(ctx)) {
+		ctx->esd_failures++;
+		st7703_esd_recover(ctx);
+	}
+	if (st7703_esd_armed(ctx))
+		schedule_delayed_work(&ctx->esd_work,
+				      msecs_to_jiffies(ctx->esd_period_ms));
+	mutex_unlock(&ctx->lock);
+}
+
+static void st7703_bl_work(struct work_struct *work)
+{
+	struct st7703 *ctx = container_of(to_delayed_work(work), struct st7703,
+					  bl_work);
+	struct mipi_dsi_multi_context dsi_ctx = { .dsi = to_mipi_dsi_device(ctx->dev) };
+
+	mutex_lock(&ctx->lock);
+	/* Otherwise the next enable takes care of it */
+	if (ctx->power_state == ST7703_POWER_ENABLED)
+		st7703_write_brightness(ctx, &dsi_ctx, false);
+	mutex_unlock(&ctx->lock);
+}
+
+static int st7703_bl_update_status(struct backlight_device *bl)
+{
+	struct st7703 *ctx = bl_get_data(bl);
+
+	/*
+	 * Coalesce updates: while a write is pending, further changes only
+	 * move the target value, so a slider drag costs at most one write per
+	 * frame. The panel is not told which mode is active, so use the frame
+	 * time of the slowest one.
+	 */
+	schedule_delayed_work(&ctx->bl_work,
+			      msecs_to_jiffies(ST7703_BL_COALESCE_MS));
+
+	return 0;
+}
+
+static int st7703_bl_get_brightness(struct backlight_device *bl)
+{
+	struct st7703 *ctx = bl_get_data(bl);
+	struct mipi_dsi_device *dsi = to_mipi_dsi_device(ctx->dev);
+	int brightness = bl->props.brightness;
+	u8 val;
+
+	mutex_lock(&ctx->lock);
+	if (ctx->power_state == ST7703_POWER_ENABLED &&
+	    mipi_dsi_dcs_read(dsi, MIPI_DCS_GET_DISPLAY_BRIGHTNESS,
+			      &val, sizeof(val)) == sizeof(val))
+		brightness = val;
+	mutex_unlock(&ctx->lock);
+
+	return brightness;
+}
+
+static const struct backlight_ops st7703_bl_ops = {
+	.update_status = st7703_bl_update_status,
+	.get_brightness = st7703_bl_get_brightness,
+};
+
+static int st7703_dcs_backlight_init(struct st7703 *ctx)
+{
+	const struct backlight_properties props = {
+		.type = BACKLIGHT_RAW,
+		.brightness = 255,
+		.max_brightness = 255,
+	};
+	int ret;
+
+	ret = devm_delayed_work_autocancel(ctx->dev, &ctx->bl_work,
+					   st7703_bl_work);
+	if (ret)
+		return ret;
+
+	ctx->bl_hw = -1;
+	ctx->dcs_bl = devm_backlight_device_register(ctx->dev, dev_name(ctx->dev),
+						     ctx->dev, ctx, &st7703_bl_ops,
+						     &props);
+	if (IS_ERR(ctx->dcs_bl))
+		return dev_err_probe(ctx->dev, PTR_ERR(ctx->dcs_bl),
+				     "Failed to register DCS backlight\n");
+
+	/* drm_panel switches it off and on around disable/enable */
+	ctx->panel.backlight = ctx->dcs_bl;
+
+	return 0;
+}
+
+/* Fills buf with the SETGAMMA command the init sequence sends */
+static int st7703_current_gamma(struct st7703 *ctx, u8 *buf)
+{
+	const u8 *seq = st7703_find_cmd(ctx->desc->init_seq, ST7703_CMD_SETGAMMA);
+
+	if (!seq || seq[1] != 1 + ST7703_GAMMA_LEN)
+		return -ENOENT;
+
+	memcpy(buf, &seq[2], seq[1]);
+	st7703_patch_command(ctx->desc->init_patch, buf, seq[1]);
+	st7703_patch_command(ctx->gamma_override, buf, seq[1]);
+	return 0;
+}
+
+static ssize_t gamma_show(struct device *dev, struct device_attribute *attr,
+			  char *buf)
+{
+	struct st7703 *ctx = dev_get_drvdata(dev);
+	u8 cmd[1 + ST7703_GAMMA_LEN];
+	int ret;
+
+	mutex_lock(&ctx->lock);
+	ret = st7703_current_gamma(ctx, cmd);
+	mutex_unlock(&ctx->lock);
+	if (ret)
+		return ret;
+
+	return sysfs_emit(buf, "%*phN\n", ST7703_GAMMA_LEN, &cmd[1]);
+}
+
+static ssize_t gamma_store(struct device *dev, struct device_attribute *attr,
+			   const char *buf, size_t count)
+{
+	struct st7703 *ctx = dev_get_drvdata(dev);
+	struct mipi_dsi_device *dsi = to_mipi_dsi_device(dev);
+	u8 table[ST7703_GAMMA_LEN], cmd[1 + ST7703_GAMMA_LEN];
+	u8 *patch = ctx->gamma_patch;
+	bool reset;
+	int ret;
+
+	reset = sysfs_streq(buf, "default");
+	if (!reset && (strcspn(buf, "\n") != 2 * ST7703_GAMMA_LEN ||
+		       hex2bin(table, buf, ST7703_GAMMA_LEN)))
+		return -EINVAL;
+
+	mutex_lock(&ctx->lock);
+	if (reset) {
+		ctx->gamma_override = NULL;
+	} else {
+		patch[0] = ST7703_SEQ_PATCH;
+		patch[1] = 2 + ST7703_GAMMA_LEN;
+		patch[2] = ST7703_CMD_SETGAMMA;
+		patch[3] = 0;
+		memcpy(&patch[4], table, ST7703_GAMMA_LEN);
+		patch[4 + ST7703_GAMMA_LEN] = ST7703_SEQ_END;
+		ctx->gamma_override = patch;
+	}
+
+	/*
+	 * Every init applies the override, only a powered panel needs it now.
+	 * After the async reset the link may not be up yet, and init follows.
+	 */
+	ret = st7703_current_gamma(ctx, cmd);
+	if (!ret && ctx->power_state != ST7703_POWER_OFF && !ctx->reset_done) {
+		ret = mipi_dsi_dcs_write_buffer(dsi, cmd, sizeof(cmd));
+		if (ret >= 0)
+			st7703_shadow(ctx, cmd, sizeof(cmd), true);
+	}
+	mutex_unlock(&ctx->lock);
+
+	return ret < 0 ? ret : count;
+}
+static DEVICE_ATTR_RW(gamma);
+
+static ssize_t cabc_mode_show(struct device *dev,
+			      struct device_attribute *attr, char *buf)
+{
+	struct st7703 *ctx = dev_get_drvdata(dev);
+
+	return sysfs_emit(buf, "%s\n", st7703_cabc_names[ctx->cabc_mode]);
+}
+
+static ssize_t cabc_mode_store(struct device *dev,
+			       struct device_attribute *attr,
+			       const char *buf, size_t count)
+{
+	struct st7703 *ctx = dev_get_drvdata(dev);
+	struct mipi_dsi_multi_context dsi_ctx = { .dsi = to_mipi_dsi_device(dev) };
+	int mode;
+
+	mode = sysfs_match_string(st7703_cabc_names, buf);
+	if (mode < 0)
+		return mode;
+
+	mutex_lock(&ctx->lock);
+	ctx->cabc_mode = mode;
+	/* Otherwise the next enable takes care of it */
+	if (ctx->power_state == ST7703_POWER_ENABLED)
+		st7703_write_cabc(ctx, &dsi_ctx);
+	mutex_unlock(&ctx->lock);
+
+	return dsi_ctx.accum_err ?: count;
+}
+static DEVICE_ATTR_RW(cabc_mode);
+
+static ssize_t activity_store(struct device *dev, struct device_attribute *attr,
+			      const char *buf, size_t count)
+{
+	st7703_mark_busy(dev_get_drvdata(dev));
+
+	return count;
+}
+static DEVICE_ATTR_WO(activity);
+
+static ssize_t esd_period_ms_show(struct device *dev,
+				  struct device_attribute *attr, char *buf)
+{
+	struct st7703 *ctx = dev_get_drvdata(dev);
+
+	return sysfs_emit(buf, "%u\n", ctx->esd_period_ms);
+}
+
+static ssize_t esd_period_ms_store(struct device *dev,
+				   struct device_attribute *attr,
+				   const char *buf, size_t count)
+{
+	struct st7703 *ctx = dev_get_drvdata(dev);
+	u32 period;
+	int ret;
+
+	ret = kstrtou32(buf, 0, &period);
+	if (ret)
+		return ret;
+
+	mutex_lock(&ctx->lock);
+	ctx->esd_period_ms = period;
+	if (st7703_esd_armed(ctx))
+		mod_delayed_work(system_wq, &ctx->esd_work,
+				 msecs_to_jiffies(period));
+	else
+		cancel_delayed_work(&ctx->esd_work);
+	mutex_unlock(&ctx->lock);
+
+	return count;
+}
+static DEVICE_ATTR_RW(esd_period_ms);
+
+static struct attribute *st7703_attrs[] = {
+	&dev_attr_cabc_mode.attr,
+	&dev_attr_activity.attr,
+	&dev_attr_esd_period_ms.attr,
+	&dev_attr_gamma.attr,
+	NULL
+};
+ATTRIBUTE_GROUPS(st7703);
+
+static int allpixelson_set(void *data, u64 val)
+{
+	struct st7703 *ctx = data;
+	struct mipi_dsi_device *dsi = to_mipi_dsi_device(ctx->dev);
+	struct mipi_dsi_multi_context dsi_ctx = {.dsi = dsi};
+
+	dev_dbg(ctx->dev, "Setting all pixels on\n");
+	mipi_dsi_generic_write_seq_multi(&dsi_ctx, ST7703_CMD_ALL_PIXEL_ON);
+	mipi_dsi_msleep(&dsi_ctx, 20);
+
+	return dsi_ctx.accum_err;
+}
+
+DEFINE_SIMPLE_ATTRIBUTE(allpixelson_fops, NULL,
+			allpixelson_set, "%llu\n");
+
+static int st7703_cmp_u32(const void *a, const void *b)
+{
+	u32 x = *(const u32 *)a, y = *(const u32 *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static int latency_show(struct seq_file *m, void *data)
+{
+	struct st7703 *ctx = m->private;
+	u32 samples[ST7703_LAT_SAMPLES];
+	unsigned int count, n, i;
+	int phase;
+	u64 sum;
+
+	seq_printf(m, "%-12s %8s %8s %8s %8s %8s\n",
+		   "phase", "count", "min_us", "avg_us", "max_us", "p99_us");
+
+	for (phase = 0; phase < ST7703_NUM_PHASES; phase++) {
+		mutex_lock(&ctx->lat_lock);
+		count = ctx->lat[phase].count;
+		n = min(count, ST7703_LAT_SAMPLES);
+		memcpy(samples, ctx->lat[phase].samples, n * sizeof(*samples));
+		mutex_unlock(&ctx->lat_lock);
+
+		if (!n)
+			continue;
+
+		sort(samples, n, sizeof(*samples), st7703_cmp_u32, NULL);
+		for (sum = 0, i = 0; i < n; i++)
+			sum += samples[i];
+
+		seq_printf(m, "%-12s %8u %8u %8llu %8u %8u\n",
+			   st7703_phase_names[phase], count, samples[0],
+			   div_u64(sum, n), samples[n - 1],
+			   samples[DIV_ROUND_UP(n * 99, 100) - 1]);
+	}
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(latency);
+
+static int esd_show(struct seq_file *m, void *data)
+{
+	struct st7703 *ctx = m->private;
+
+	mutex_lock(&ctx->lock);
+	seq_printf(m, "period_ms:   %u\n", ctx->esd_period_ms);
+	seq_printf(m, "checks:      %llu\n", ctx->esd_checks);
+	seq_printf(m, "failures:    %llu\n", ctx->esd_failures);
+	seq_printf(m, "recoveries:  %llu\n", ctx->esd_recoveries);
+	seq_printf(m, "last_us:     %lld\n", ctx->esd_last_us);
+	seq_printf(m, "max_us:      %lld\n", ctx->esd_max_us);
+	mutex_unlock(&ctx->lock);
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(esd);
+
+static int power_states_show(struct seq_file *m, void *data)
+{
+	struct st7703 *ctx = m->private;
+	u64 residency_us, energy_uj, total_uj = 0;
+	int state;
+
+	seq_printf(m, "%-10s %8s %14s %10s %12s\n",
+		   "state", "enters", "residency_ms", "power_uw", "energy_mj");
+
+	mutex_lock(&ctx->lock);
+	/* Bring the current state up to date */
+	st7703_set_state(ctx, ctx->power_state);
+
+	for (state = 0; state < ST7703_NUM_POWER_STATES; state++) {
+		residency_us = ctx->residency_us[state];
+		energy_uj = mul_u64_u32_div(residency_us, ctx->power_uw[state],
+					    USEC_PER_SEC);
+		total_uj += energy_uj;
+
+		seq_printf(m, "%-10s %8llu %14llu %10u %12llu\n",
+			   st7703_power_names[state], ctx->state_enters[state],
+			   div_u64(residency_us, USEC_PER_MSEC),
+			   ctx->power_uw[state], div_u64(energy_uj, 1000));
+	}
+	seq_printf(m, "current: %s, total energy: %llu mJ\n",
+		   st7703_power_names[ctx->power_state], div_u64(total_uj, 1000));
+	mutex_unlock(&ctx->lock);
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(power_states);
+
+/* Served from the shadow, without any traffic on the link */
+static int registers_show(struct seq_file *m, void *data)
+{
+	struct st7703 *ctx = m->private;
+	const struct st7703_reg *reg;
+	unsigned int i;
+
+	mutex_lock(&ctx->lock);
+	for (i = 0; i < ctx->num_regs; i++) {
+		reg = &ctx->regs[i];
+		seq_printf(m, "%02x %-7s %*ph\n", reg->cmd,
+			   reg->dcs ? "dcs" : "generic", reg->len, reg->val);
+	}
+	mutex_unlock(&ctx->lock);
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(registers);
+
+/* DCS command reading back what @reg wrote, 0 if it cannot be read */
+static u8 st7703_read_cmd(const struct st7703_reg *reg)
+{
+	switch (reg->cmd) {
+	case MIPI_DCS_SET_PIXEL_FORMAT:
+		return MIPI_DCS_GET_PIXEL_FORMAT;
+	case MIPI_DCS_SET_DISPLAY_BRIGHTNESS:
+		return MIPI_DCS_GET_DISPLAY_BRIGHTNESS;
+	case MIPI_DCS_WRITE_CONTROL_DISPLAY:
+		return MIPI_DCS_GET_CONTROL_DISPLAY;
+	case MIPI_DCS_WRITE_POWER_SAVE:
+		return MIPI_DCS_GET_POWER_SAVE;
+	}
+
+	/* Manufacturer commands read back with their own code */
+	return reg->cmd >= ST7703_CMD_SETAPID ? reg->cmd : 0;
+}
+
+/*
+ * Read back every shadowed register and list the ones that differ. All
+ * reads are issued back to back under the lock before anything is printed,
+ * so the link sees a single burst of LP turnarounds, and only on demand.
+ */
+static int verify_show(struct seq_file *m, void *data)
+{
+	struct st7703 *ctx = m->private;
+	struct mipi_dsi_device *dsi = to_mipi_dsi_device(ctx->dev);
+	unsigned int i, n, differ = 0, failed = 0;
+	int err[ST7703_MAX_REGS] = { 0 };
+	const struct st7703_reg *reg;
+	struct st7703_reg *rb;
+	ktime_t start;
+	ssize_t ret;
+	s64 us;
+
+	/* Read back values, rb[i].cmd is 0 for registers that were skipped */
+	rb = kcalloc(ST7703_MAX_REGS, sizeof(*rb), GFP_KERNEL);
+	if (!rb)
+		return -ENOMEM;
+
+	mutex_lock(&ctx->lock);
+	if (ctx->power_state == ST7703_POWER_OFF || ctx->reset_done) {
+		mutex_unlock(&ctx->lock);
+		kfree(rb);
+		return -ENODEV;
+	}
+
+	start = ktime_get();
+	n = ctx->num_regs;
+	for (i = 0; i < n; i++) {
+		reg = &ctx->regs[i];
+		rb[i].cmd = st7703_read_cmd(reg);
+		if (!rb[i].cmd)
+			continue;
+
+		ret = st7703_read_reg(dsi, reg, rb[i].cmd, rb[i].val);
+		if (ret < 0)
+			err[i] = ret;
+		else
+			rb[i].len = ret;
+	}
+	us = ktime_us_delta(ktime_get(), start);
+
+	for (i = 0; i < n; i++) {
+		reg = &ctx->regs[i];
+		if (!rb[i].cmd) {
+			seq_printf(m, "%02x not readable\n", reg->cmd);
+		} else if (err[i]) {
+			failed++;
+			seq_printf(m, "%02x read failed: %d\n", reg->cmd, err[i]);
+		} else if (rb[i].len != reg->len ||
+			   memcmp(rb[i].val, reg->val, reg->len)) {
+			differ++;
+			seq_printf(m, "%02x wrote %*ph\n   read  %*ph\n", reg->cmd,
+				   reg->len, reg->val, rb[i].len, rb[i].val);
+		}
+	}
+	mutex_unlock(&ctx->lock);
+
+	seq_printf(m, "%u registers, %u differ, %u failed, read in %lld us\n",
+		   n, differ, failed, us);
+	kfree(rb);
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(verify);
+
+static void st7703_debugfs_init(struct st7703 *ctx)
+{
+	char name[64];
+
+	/* One directory per panel, e.g. for two panels on DSI0 and DSI1 */
+	snprintf(name, sizeof(name), "%s-%s", DRV_NAME, dev_name(ctx->dev));
+	ctx->debugfs = debugfs_create_dir(name, NULL);
+
+	debugfs_create_file("allpixelson", 0600, ctx->debugfs, ctx,
+			    &allpixelson_fops);
+	debugfs_create_file("latency", 0400, ctx->debugfs, ctx,
+			    &latency_fops);
+	debugfs_create_file("esd", 0400, ctx->debugfs, ctx, &esd_fops);
+	debugfs_create_file("power_states", 0400, ctx->debugfs, ctx,
+			    &power_states_fops);
+	debugfs_create_file("registers", 0400, ctx->debugfs, ctx,
+			    &registers_fops);
+	debugfs_create_file("verify", 0400, ctx->debugfs, ctx, &verify_fops);
+}
+
+static void st7703_debugfs_remove(struct st7703 *ctx)
+{
+	debugfs_remove_recursive(ctx->debugfs);
+	ctx->debugfs = NULL;
+}
+
+static int st7703_parse_format(struct st7703 *ctx, struct mipi_dsi_device *dsi)
+{
+	const char *name;
+	unsigned int i;
+
+	dsi->format = ctx->desc->format;
+	if (of_property_read_string(ctx->dev->of_node, "sitronix,pixel-format",
+				    &name))
+		return 0;
+
+	for (i = 0; i < ARRAY_SIZE(st7703_formats); i++) {
+		if (!(ctx->desc->formats & BIT(i)) ||
+		    strcmp(name, st7703_formats[i].name))
+			continue;
+
+		dsi->format = i;
+		return 0;
+	}
+
+	return dev_err_probe(ctx->dev, -EINVAL,
+			     "Unsupported pixel format %s\n", name);
+}
+
+static void st7703_add_dt_patch(struct st7703 *ctx, u8 cmd, u8 off, u8 val)
+{
+	u8 *patch = &ctx->dt_patch[ctx->dt_patch_len];
+
+	if (WARN_ON(ctx->dt_patch_len + 5 >= sizeof(ctx->dt_patch)))
+		return;
+
+	patch[0] = ST7703_SEQ_PATCH;
+	patch[1] = 2 + 1;
+	patch[2] = cmd;
+	patch[3] = off;
+	patch[4] = val;
+	patch[5] = ST7703_SEQ_END;
+	ctx->dt_patch_len += 5;
+}
+
+static int st7703_parse_flip(struct st7703 *ctx)
+{
+	struct device_node *np = ctx->dev->of_node;
+	const u8 *seq;
+	u8 flip = 0;
+
+	if (of_property_read_bool(np, "sitronix,flip-horizontal"))
+		flip |= ST7703_PANEL_SS | ST7703_PANEL_BGR;
+	if (of_property_read_bool(np, "sitronix,flip-vertical"))
+		flip |= ST7703_PANEL_GS;
+	if (!flip)
+		return 0;
+
+	seq = st7703_find_cmd(ctx->desc->init_seq, ST7703_CMD_SETPANEL);
+	if (!seq || seq[1] < 2)
+		return dev_err_probe(ctx->dev, -EINVAL,
+				     "Init sequence has no SETPANEL to flip\n");
+
+	st7703_add_dt_patch(ctx, ST7703_CMD_SETPANEL, 0, seq[3] ^ flip);
+
+	return 0;
+}
+
+/*
+ * Pick the lane count from the wiring in DT and the bandwidth the fastest
+ * mode needs. With sitronix,auto-lanes set, as few lanes as fit are used,
+ * which lowers PHY power and EMI; otherwise all wired lanes up to the
+ * descriptor's count are. hs_rate is the receiver's lane limit, so that
+ * hosts keep their burst mode headroom above the payload rate.
+ */
+static int st7703_link_budget(struct st7703 *ctx, struct mipi_dsi_device *dsi)
+{
+	struct device_node *np = ctx->dev->of_node;
+	unsigned int bpp = mipi_dsi_pixel_format_to_bpp(dsi->format);
+	unsigned int lane_kbps = ST7703_LANE_MAX_KBPS * ST7703_LANE_LOAD_PCT / 100;
+	const struct drm_display_mode *mode = &ctx->desc->modes[0];
+	unsigned int wired, lanes, i;
+	const u8 *seq;
+	u64 kbps = 0;
+	int ret;
+
+	for (i = 0; i < ctx->desc->num_modes; i++)
+		kbps = max_t(u64, kbps, (u64)ctx->desc->modes[i].clock * bpp);
+
+	wired = ctx->desc->lanes;
+	ret = drm_of_get_data_lanes_count_ep(np, 0, -1, 1, 4);
+	if (ret > 0)
+		wired = min_t(unsigned int, wired, ret);
+
+	lanes = wired;
+	if (of_property_read_bool(np, "sitronix,auto-lanes"))
+		lanes = clamp_t(unsigned int, DIV_ROUND_UP_ULL(kbps, lane_kbps),
+				1, wired);
+
+	if (kbps > (u64)lanes * lane_kbps)
+		return dev_err_probe(ctx->dev, -EINVAL,
+				     "%llu kbps do not fit on %u lanes\n",
+				     kbps, lanes);
+
+	if (lanes != ctx->desc->lanes) {
+		seq = st7703_find_cmd(ctx->desc->init_seq, ST7703_CMD_SETMIPI);
+		if (!seq || seq[1] < 2)
+			return dev_err_probe(ctx->dev, -EINVAL,
+					     "Init sequence has no SETMIPI for %u lanes\n",
+					     lanes);
+
+		st7703_add_dt_patch(ctx, ST7703_CMD_SETMIPI, 0,
+				    (seq[3] & ~ST7703_MIPI_LANES) | (lanes - 1));
+	}
+
+	dsi->lanes = lanes;
+	dsi->hs_rate = ST7703_LANE_MAX_KBPS * 1000UL;
+
+	dev_info(ctx->dev,
+		 "link budget: %llu kbps for %ux%u %ubpp, %u of %u lanes at %llu kbps (%llu%% of max)\n",
+		 kbps, mode->hdisplay, mode->vdisplay, bpp, lanes, wired,
+		 div_u64(kbps, lanes),
+		 div_u64(kbps * 100, (u64)lanes * ST7703_LANE_MAX_KBPS));
+
+	return 0;
+}
+
+/* Light sleep and async power-up leave the supplies on past unprepare */
+static void st7703_release_supplies(struct st7703 *ctx)
+{
+	flush_work(&ctx->power_work);
+
+	mutex_lock(&ctx->lock);
+	if (ctx->power_state == ST7703_POWER_SLEEP || ctx->reset_done)
+		st7703_power_off(ctx);
+	mutex_unlock(&ctx->lock);
+}
+
+static int st7703_probe(struct mipi_dsi_device *dsi)
+{
+	struct device *dev = &dsi->dev;
+	struct st7703 *ctx;
+	int ret;
+
+	ctx = devm_kzalloc(dev, sizeof(*ctx), GFP_KERNEL);
+	if (!ctx)
+		return -ENOMEM;
+	
+	drm_panel_init(&ctx->panel, dev, &st7703_drm_funcs,
+		       DRM_MODE_CONNECTOR_DSI);
 
 	ctx->reset_gpio = devm_gpiod_get(dev, "reset", GPIOD_OUT_LOW);
 	if (IS_ERR(ctx->reset_gpio))
@@ -543,11 +2232,49 @@ static int st7703_probe(struct mipi_dsi_device *dsi)
 
 	ctx->dev = dev;
 	ctx->desc = of_device_get_match_data(dev);
+	ctx->state_since = ktime_get();
+	mutex_init(&ctx->lock);
+	mutex_init(&ctx->lat_lock);
 
 	dsi->mode_flags = ctx->desc->mode_flags;
-	dsi->format = ctx->desc->format;
 	dsi->lanes = ctx->desc->lanes;
 
+	ret = st7703_parse_format(ctx, dsi);
+	if (ret)
+		return ret;
+
+	ret = st7703_parse_flip(ctx);
+	if (ret)
+		return ret;
+
+	ret = st7703_link_budget(ctx, dsi);
+	if (ret)
+		return ret;
+
+	ctx->light_sleep = of_property_read_bool(dev->of_node, "sitronix,light-sleep");
+	ctx->poll_ready = of_property_read_bool(dev->of_node, "sitronix,poll-ready");
+	ctx->hs_cmds = of_property_read_bool(dev->of_node, "sitronix,hs-commands");
+	ctx->keep_boot_on = of_property_read_bool(dev->of_node, "sitronix,keep-boot-on");
+	/* Firmware sets up the panel default, anything else needs an init */
+	if (ctx->keep_boot_on &&
+	    (ctx->dt_patch_len || dsi->format != ctx->desc->format)) {
+		dev_info(dev, "Lanes, format or scan direction differ from firmware, ignoring keep-boot-on\n");
+		ctx->keep_boot_on = false;
+	}
+	/* A reset at probe would blank the firmware's splash screen */
+	ctx->async_power = !ctx->keep_boot_on &&
+			   of_property_read_bool(dev->of_node, "sitronix,async-power-up");
+	INIT_WORK(&ctx->power_work, st7703_power_work);
+	init_completion(&ctx->power_done);
+
+	/* Measured values from DT replace the descriptor's estimates */
+	memcpy(ctx->power_uw, ctx->desc->power_uw, sizeof(ctx->power_uw));
+	of_property_read_u32_array(dev->of_node, "sitronix,state-power-microwatt",
+				   ctx->power_uw, ST7703_NUM_POWER_STATES);
+	of_property_read_u32(dev->of_node, "sitronix,idle-delay-ms", &ctx->idle_ms);
+	of_property_read_u32(dev->of_node, "sitronix,doze-delay-ms", &ctx->doze_ms);
+	of_property_read_u32(dev->of_node, "sitronix,esd-check-ms", &ctx->esd_period_ms);
+
 	ctx->vcc = devm_regulator_get(dev, "vcc");
 	if (IS_ERR(ctx->vcc))
 		return dev_err_probe(dev, PTR_ERR(ctx->vcc), "Failed to request vcc regulator\n");
@@ -565,21 +2292,47 @@ static int st7703_probe(struct mipi_dsi_device *dsi)
 	if (ret)
 		return ret;
 
+	if (!ctx->panel.backlight) {
+		ret = st7703_dcs_backlight_init(ctx);
+		if (ret)
+			return ret;
+	}
+
+	ret = devm_delayed_work_autocancel(dev, &ctx->esd_work, st7703_esd_work);
+	if (ret)
+		return ret;
+
+	if (ctx->idle_ms) {
+		ret = st7703_runtime_pm_init(ctx);
+		if (ret)
+			return ret;
+	}
+
+	/*
+	 * Queued before attaching: the host can bind the DRM device and
+	 * modeset from within attach, and prepare then waits for this work.
+	 * Every panel powers up on its own, so two panels ramp in parallel.
+	 */
+	if (ctx->async_power)
+		queue_work(system_unbound_wq, &ctx->power_work);
+
 	drm_panel_add(&ctx->panel);
 
 	ret = mipi_dsi_attach(dsi);
 	if (ret < 0) {
 		dev_err(dev, "mipi_dsi_attach failed (%d). Is host ready?\n", ret);
 		drm_panel_remove(&ctx->panel);
+		st7703_release_supplies(ctx);
 		return ret;
 	}
 
 	dev_info(dev, "%ux%u@%u %ubpp dsi %udl - ready\n",
-		 ctx->desc->mode->hdisplay, ctx->desc->mode->vdisplay,
-		 drm_mode_vrefresh(ctx->desc->mode),
+		 ctx->desc->modes[0].hdisplay, ctx->desc->modes[0].vdisplay,
+		 drm_mode_vrefresh(&ctx->desc->modes[0]),
 		 mipi_dsi_pixel_format_to_bpp(dsi->format), dsi->lanes);
 
 	st7703_debugfs_init(ctx);
+
 	return 0;
 }
 
@@ -593,7 +2346,7 @@ static void st7703_remove(struct mipi_dsi_device *dsi)
 		dev_err(&dsi->dev, "Failed to detach from DSI host: %d\n", ret);
 
 	drm_panel_remove(&ctx->panel);
-
+	st7703_release_supplies(ctx);
 	st7703_debugfs_remove(ctx);
 }
 
@@ -611,10 +2364,16 @@ static struct mipi_dsi_driver st7703_driver = {
 	.driver = {
 		.name = DRV_NAME,
 		.of_match_table = st7703_of_match,
+		.dev_groups = st7703_groups,
+		.pm = pm_ptr(&st7703_pm_ops),
 	},
 };
 module_mipi_dsi_driver(st7703_driver);
 
+#ifdef ST7703_KUNIT_TEST
+#include "panel-sitronix-st7703-kunit.c"
+#endif
+
 MODULE_AUTHOR("Guido Günther <agx@sigxcpu.org>");
 MODULE_DESCRIPTION("DRM driver for Sitronix ST7703 based MIPI DSI panels");
 MODULE_LICENSE("GPL v2");
\ No newline at end of file
@@ -0,0 +1,807 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * KUnit tests for the ST7703 panel driver, included at the end of the driver
+ * when built with ST7703_KUNIT=1. Each test probes the driver through a fake
+ * DSI host, with the DT properties in a runtime-created node, fake vcc and
+ * iovcc regulators and a fake reset GPIO. The host records every packet and
+ * keeps the written parameters, so reads return what the controller holds
+ * until its reset line is asserted.
+ */
+
+#include <kunit/device.h>
+#include <kunit/of.h>
+#include <kunit/test.h>
+#include <linux/gpio/driver.h>
+#include <linux/gpio/machine.h>
+#include <linux/regulator/driver.h>
+#include <linux/regulator/machine.h>
+
+#define ST7703_TEST_MAX_MSGS 64
+
+/* Bytes the GX040HD and JH057N00900 init sequences put on the link */
+#define ST7703_TEST_GX040HD_BYTES 267
+#define ST7703_TEST_JH057N_BYTES  221
+
+#define ST7703_TEST_RESET_CHIP "st7703-test-reset"
+
+struct st7703_test_msg {
+	u8 type;
+	bool lp;
+	ktime_t time;
+	size_t len;
+	u8 buf[ST7703_SEQ_MAX_LEN];
+};
+
+struct st7703_test_supply {
+	struct regulator_desc desc;
+	struct regulator_init_data init;
+	struct regulator_consumer_supply consumer;
+	bool on;
+	unsigned int enables;
+};
+
+struct st7703_test_host {
+	struct mipi_dsi_host host;
+	struct st7703_test_msg msgs[ST7703_TEST_MAX_MSGS];
+	unsigned int num_msgs;
+	size_t bytes;
+	unsigned int reads;
+	bool fail_hs;		/* reject every HS transfer with -EIO */
+
+	/* Parameters last written per command, cleared by a reset */
+	u8 regs[256][ST7703_SEQ_MAX_LEN - 1];
+	u8 reg_len[256];
+
+	struct st7703_test_supply vcc;
+	struct st7703_test_supply iovcc;
+	struct gpio_chip reset_chip;
+	int reset_val;		/* raw level, the line is active low */
+	unsigned int resets;	/* releases from reset */
+	struct gpiod_lookup_table *lookup;
+
+	struct of_changeset ocs;
+	struct device_node *np;
+	struct mipi_dsi_device *dsi;
+};
+
+static ssize_t st7703_test_read(struct st7703_test_host *th,
+				const struct mipi_dsi_msg *msg)
+{
+	u8 cmd = ((const u8 *)msg->tx_buf)[0];
+	size_t len = min_t(size_t, msg->rx_len, th->reg_len[cmd]);
+
+	th->reads++;
+	memcpy(msg->rx_buf, th->regs[cmd], len);
+
+	return len;
+}
+
+static ssize_t st7703_test_transfer(struct mipi_dsi_host *host,
+				    const struct mipi_dsi_msg *msg)
+{
+	struct st7703_test_host *th = container_of(host, struct st7703_test_host,
+						   host);
+	bool lp = msg->flags & MIPI_DSI_MSG_USE_LPM;
+	const u8 *tx = msg->tx_buf;
+	struct st7703_test_msg *m;
+
+	if (th->fail_hs && !lp)
+		return -EIO;
+
+	if (msg->type == MIPI_DSI_SET_MAXIMUM_RETURN_PACKET_SIZE)
+		return msg->tx_len;
+	if (msg->rx_len)
+		return st7703_test_read(th, msg);
+
+	if (th->num_msgs == ST7703_TEST_MAX_MSGS || msg->tx_len > sizeof(m->buf))
+		return -ENOSPC;
+
+	m = &th->msgs[th->num_msgs++];
+	m->type = msg->type;
+	m->lp = lp;
+	m->time = ktime_get();
+	m->len = msg->tx_len;
+	memcpy(m->buf, tx, msg->tx_len);
+	th->bytes += msg->tx_len;
+
+	if (msg->tx_len > 1) {
+		memcpy(th->regs[tx[0]], &tx[1], msg->tx_len - 1);
+		th->reg_len[tx[0]] = msg->tx_len - 1;
+	}
+
+	return msg->tx_len;
+}
+
+static int st7703_test_attach(struct mipi_dsi_host *host,
+			      struct mipi_dsi_device *dsi)
+{
+	return 0;
+}
+
+static int st7703_test_detach(struct mipi_dsi_host *host,
+			      struct mipi_dsi_device *dsi)
+{
+	return 0;
+}
+
+static const struct mipi_dsi_host_ops st7703_test_host_ops = {
+	.attach = st7703_test_attach,
+	.detach = st7703_test_detach,
+	.transfer = st7703_test_transfer,
+};
+
+static int st7703_test_supply_enable(struct regulator_dev *rdev)
+{
+	struct st7703_test_supply *s = rdev_get_drvdata(rdev);
+
+	s->on = true;
+	s->enables++;
+
+	return 0;
+}
+
+static int st7703_test_supply_disable(struct regulator_dev *rdev)
+{
+	struct st7703_test_supply *s = rdev_get_drvdata(rdev);
+
+	s->on = false;
+
+	return 0;
+}
+
+static int st7703_test_supply_is_enabled(struct regulator_dev *rdev)
+{
+	struct st7703_test_supply *s = rdev_get_drvdata(rdev);
+
+	return s->on;
+}
+
+static const struct regulator_ops st7703_test_supply_ops = {
+	.enable = st7703_test_supply_enable,
+	.disable = st7703_test_supply_disable,
+	.is_enabled = st7703_test_supply_is_enabled,
+};
+
+/* Register @s as the @supply of the DSI device called @consumer */
+static void st7703_test_add_supply(struct kunit *test,
+				   struct st7703_test_supply *s,
+				   const char *name, const char *supply,
+				   const char *consumer)
+{
+	struct st7703_test_host *th = test->priv;
+	struct regulator_config config = {
+		.dev = th->host.dev,
+		.init_data = &s->init,
+		.driver_data = s,
+	};
+	struct regulator_dev *rdev;
+
+	s->desc.name = name;
+	s->desc.type = REGULATOR_VOLTAGE;
+	s->desc.owner = THIS_MODULE;
+	s->desc.ops = &st7703_test_supply_ops;
+	s->consumer.supply = supply;
+	s->consumer.dev_name = consumer;
+	s->init.constraints.valid_ops_mask = REGULATOR_CHANGE_STATUS;
+	s->init.consumer_supplies = &s->consumer;
+	s->init.num_consumer_supplies = 1;
+
+	rdev = devm_regulator_register(th->host.dev, &s->desc, &config);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, rdev);
+}
+
+static int st7703_test_reset_output(struct gpio_chip *gc, unsigned int offset,
+				    int value)
+{
+	struct st7703_test_host *th = gpiochip_get_data(gc);
+
+	/* Asserting reset loses everything init wrote */
+	if (!value)
+		memset(th->reg_len, 0, sizeof(th->reg_len));
+	else if (!th->reset_val)
+		th->resets++;
+	th->reset_val = value;
+
+	return 0;
+}
+
+static void st7703_test_reset_set(struct gpio_chip *gc, unsigned int offset,
+				  int value)
+{
+	st7703_test_reset_output(gc, offset, value);
+}
+
+static int st7703_test_reset_get_direction(struct gpio_chip *gc,
+					   unsigned int offset)
+{
+	return GPIO_LINE_DIRECTION_OUT;
+}
+
+static int st7703_test_init(struct kunit *test)
+{
+	struct st7703_test_host *th;
+	struct device *dev;
+
+	of_root_kunit_skip(test);
+
+	th = kunit_kzalloc(test, sizeof(*th), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, th);
+
+	dev = kunit_device_register(test, "st7703-test-host");
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, dev);
+
+	th->host.dev = dev;
+	th->host.ops = &st7703_test_host_ops;
+	KUNIT_ASSERT_EQ(test, mipi_dsi_host_register(&th->host), 0);
+	test->priv = th;
+
+	th->reset_val = 1;
+	th->reset_chip.label = ST7703_TEST_RESET_CHIP;
+	th->reset_chip.parent = dev;
+	th->reset_chip.owner = THIS_MODULE;
+	th->reset_chip.base = -1;
+	th->reset_chip.ngpio = 1;
+	th->reset_chip.direction_output = st7703_test_reset_output;
+	th->reset_chip.set = st7703_test_reset_set;
+	th->reset_chip.get_direction = st7703_test_reset_get_direction;
+	KUNIT_ASSERT_EQ(test, devm_gpiochip_add_data(dev, &th->reset_chip, th), 0);
+
+	return 0;
+}
+
+static void st7703_test_exit(struct kunit *test)
+{
+	struct st7703_test_host *th = test->priv;
+	struct st7703 *ctx;
+
+	if (!th)
+		return;
+
+	if (th->dsi) {
+		/* DRM would turn the panel off before unbinding it */
+		ctx = mipi_dsi_get_drvdata(th->dsi);
+		if (ctx && ctx->power_state == ST7703_POWER_ENABLED)
+			st7703_disable(&ctx->panel);
+		if (ctx && ctx->power_state == ST7703_POWER_ON)
+			st7703_unprepare(&ctx->panel);
+
+		mipi_dsi_device_unregister(th->dsi);
+	}
+
+	mipi_dsi_host_unregister(&th->host);
+
+	if (th->lookup)
+		gpiod_remove_lookup_table(th->lookup);
+
+	if (th->np) {
+		of_changeset_revert(&th->ocs);
+		of_changeset_destroy(&th->ocs);
+		of_node_put(th->np);
+	}
+}
+
+/* A DT property of the panel node, boolean without a value */
+struct st7703_test_prop {
+	const char *name;
+	const char *str;
+	u32 val;
+	bool is_u32;
+};
+
+#define ST7703_TEST_BOOL(_name)		{ .name = _name }
+#define ST7703_TEST_U32(_name, _val)	{ .name = _name, .val = _val, .is_u32 = true }
+#define ST7703_TEST_STR(_name, _str)	{ .name = _name, .str = _str }
+
+/* Create the panel node for @desc with @props, NULL or terminated by {} */
+static void st7703_test_add_node(struct kunit *test,
+				 const struct st7703_panel_desc *desc,
+				 const struct st7703_test_prop *props)
+{
+	struct st7703_test_host *th = test->priv;
+	const struct of_device_id *id;
+	struct device_node *root;
+	int ret;
+
+	for (id = st7703_of_match; id->compatible[0]; id++)
+		if (id->data == desc)
+			break;
+	KUNIT_ASSERT_NE(test, id->compatible[0], '\0');
+
+	root = of_find_node_by_path("/");
+	KUNIT_ASSERT_NOT_NULL(test, root);
+
+	of_changeset_init(&th->ocs);
+	th->np = of_changeset_create_node(&th->ocs, root, "st7703-test-panel");
+	of_node_put(root);
+	KUNIT_ASSERT_NOT_NULL(test, th->np);
+
+	ret = of_changeset_add_prop_string(&th->ocs, th->np, "compatible",
+					   id->compatible);
+	for (; !ret && props && props->name; props++) {
+		if (props->str)
+			ret = of_changeset_add_prop_string(&th->ocs, th->np,
+							   props->name, props->str);
+		else if (props->is_u32)
+			ret = of_changeset_add_prop_u32(&th->ocs, th->np,
+							props->name, props->val);
+		else
+			ret = of_changeset_add_prop_bool(&th->ocs, th->np,
+							 props->name);
+	}
+	KUNIT_ASSERT_EQ(test, ret, 0);
+	KUNIT_ASSERT_EQ(test, of_changeset_apply(&th->ocs), 0);
+}
+
+/*
+ * Bind the driver to a panel of type @desc on the fake host, with @props as
+ * its DT properties, and return the panel.
+ */
+static struct st7703 *st7703_test_probe(struct kunit *test,
+					const struct st7703_panel_desc *desc,
+					const struct st7703_test_prop *props)
+{
+	struct st7703_test_host *th = test->priv;
+	struct mipi_dsi_device_info info = { .type = "st7703" };
+	struct st7703 *ctx;
+	const char *name;
+
+	st7703_test_add_node(test, desc, props);
+
+	/* The name the DSI core gives the device on channel 0 */
+	name = devm_kasprintf(th->host.dev, GFP_KERNEL, "%s.%u",
+			      dev_name(th->host.dev), info.channel);
+	KUNIT_ASSERT_NOT_NULL(test, name);
+
+	st7703_test_add_supply(test, &th->vcc, "st7703-test-vcc", "vcc", name);
+	st7703_test_add_supply(test, &th->iovcc, "st7703-test-iovcc", "iovcc",
+			       name);
+
+	th->lookup = kunit_kzalloc(test, struct_size(th->lookup, table, 2),
+				   GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, th->lookup);
+	th->lookup->dev_id = name;
+	th->lookup->table[0] = GPIO_LOOKUP(ST7703_TEST_RESET_CHIP, 0, "reset",
+					   GPIO_ACTIVE_LOW);
+	gpiod_add_lookup_table(th->lookup);
+
+	info.node = of_node_get(th->np);
+	th->dsi = mipi_dsi_device_register_full(&th->host, &info);
+	if (IS_ERR(th->dsi)) {
+		of_node_put(info.node);
+		th->dsi = NULL;
+	}
+	KUNIT_ASSERT_NOT_NULL(test, th->dsi);
+
+	ctx = mipi_dsi_get_drvdata(th->dsi);
+	KUNIT_ASSERT_NOT_NULL_MSG(test, ctx, "probe failed");
+
+	return ctx;
+}
+
+/* Packet type the DSI core picks for a write of @len bytes */
+static u8 st7703_test_write_type(bool dcs, size_t len)
+{
+	if (dcs)
+		return len == 1 ? MIPI_DSI_DCS_SHORT_WRITE :
+		       len == 2 ? MIPI_DSI_DCS_SHORT_WRITE_PARAM :
+				  MIPI_DSI_DCS_LONG_WRITE;
+
+	return len == 1 ? MIPI_DSI_GENERIC_SHORT_WRITE_1_PARAM :
+	       len == 2 ? MIPI_DSI_GENERIC_SHORT_WRITE_2_PARAM :
+			  MIPI_DSI_GENERIC_LONG_WRITE;
+}
+
+/* Most recent duration of @phase in us */
+static u32 st7703_test_last_us(struct st7703 *ctx, enum st7703_phase phase)
+{
+	const struct st7703_lat_stats *lat = &ctx->lat[phase];
+
+	return lat->count ? lat->samples[(lat->count - 1) % ST7703_LAT_SAMPLES] : 0;
+}
+
+/* Run one drm_panel step and report what it sent and how long it took */
+static void st7703_test_step(struct kunit *test, struct st7703 *ctx,
+			     int (*step)(struct drm_panel *panel),
+			     enum st7703_phase phase)
+{
+	struct st7703_test_host *th = test->priv;
+	unsigned int msgs = th->num_msgs;
+	size_t bytes = th->bytes;
+
+	KUNIT_ASSERT_EQ(test, step(&ctx->panel), 0);
+
+	kunit_info(test, "%s: %u packets, %zu bytes, %u us\n",
+		   st7703_phase_names[phase], th->num_msgs - msgs,
+		   th->bytes - bytes, st7703_test_last_us(ctx, phase));
+}
+
+/*
+ * Check the packets from @first against the write records of the panel's
+ * init sequence, with its patches applied, and return the index of the first
+ * packet after them.
+ */
+static unsigned int st7703_test_expect_seq(struct kunit *test,
+					   struct st7703 *ctx,
+					   unsigned int first, bool lp)
+{
+	struct st7703_test_host *th = test->priv;
+	const u8 *seq = ctx->desc->init_seq;
+	const struct st7703_test_msg *m;
+	u8 buf[ST7703_SEQ_MAX_LEN];
+	unsigned int i = first;
+	u8 len;
+
+	for (; *seq != ST7703_SEQ_END; seq += 2 + len) {
+		len = seq[1];
+		if (seq[0] == ST7703_SEQ_DELAY)
+			continue;
+
+		memcpy(buf, &seq[2], len);
+		st7703_patch_command(ctx->desc->init_patch, buf, len);
+		st7703_patch_command(ctx->dt_patch, buf, len);
+
+		KUNIT_ASSERT_LT(test, i, th->num_msgs);
+		m = &th->msgs[i++];
+		KUNIT_EXPECT_EQ_MSG(test, m->type,
+				    st7703_test_write_type(seq[0] == ST7703_SEQ_DCS, len),
+				    "command %#04x", buf[0]);
+		KUNIT_EXPECT_EQ(test, m->lp, lp);
+		KUNIT_EXPECT_EQ(test, m->len, (size_t)len);
+		KUNIT_EXPECT_MEMEQ(test, m->buf, buf, len);
+	}
+
+	return i;
+}
+
+/* Delays the init sequence itself asks for, in ms */
+static unsigned int st7703_test_seq_delay(const u8 *seq)
+{
+	unsigned int ms = 0;
+
+	for (; *seq != ST7703_SEQ_END; seq += 2 + seq[1])
+		if (seq[0] == ST7703_SEQ_DELAY)
+			ms += seq[2];
+
+	return ms;
+}
+
+static void st7703_test_expect_cmd(struct kunit *test, unsigned int i, u8 cmd)
+{
+	struct st7703_test_host *th = test->priv;
+
+	KUNIT_ASSERT_LT(test, i, th->num_msgs);
+	KUNIT_EXPECT_EQ(test, th->msgs[i].type, MIPI_DSI_DCS_SHORT_WRITE);
+	KUNIT_EXPECT_EQ(test, th->msgs[i].len, (size_t)1);
+	KUNIT_EXPECT_EQ(test, th->msgs[i].buf[0], cmd);
+}
+
+/* The last packet sent, which must be @cmd with the parameter @val */
+static void st7703_test_expect_param(struct kunit *test, unsigned int i,
+				     u8 cmd, u8 val)
+{
+	struct st7703_test_host *th = test->priv;
+
+	KUNIT_ASSERT_LT(test, i, th->num_msgs);
+	KUNIT_EXPECT_EQ(test, th->msgs[i].type, MIPI_DSI_DCS_SHORT_WRITE_PARAM);
+	KUNIT_EXPECT_EQ(test, th->msgs[i].buf[0], cmd);
+	KUNIT_EXPECT_EQ(test, th->msgs[i].buf[1], val);
+}
+
+struct st7703_test_panel {
+	const char *name;
+	const struct st7703_panel_desc *desc;
+	size_t init_bytes;
+};
+
+static const struct st7703_test_panel st7703_test_panels[] = {
+	{ "gx040hd", &gx040hd_desc, ST7703_TEST_GX040HD_BYTES },
+	{ "jh057n00900", &jh057n00900_panel_desc, ST7703_TEST_JH057N_BYTES },
+	{ "xbd599", &xbd599_desc, ST7703_TEST_GX040HD_BYTES },
+};
+
+static void st7703_test_panel_desc(const struct st7703_test_panel *p,
+				   char *desc)
+{
+	strscpy(desc, p->name, KUNIT_PARAM_DESC_SIZE);
+}
+
+KUNIT_ARRAY_PARAM(st7703_test_panels, st7703_test_panels,
+		  st7703_test_panel_desc);
+
+/*
+ * Without DT options the panel is powered up and reset in prepare and
+ * powered down in unprepare.
+ */
+static void st7703_test_power_cycle(struct kunit *test)
+{
+	const struct st7703_test_panel *p = test->param_value;
+	const struct st7703_timings *t = &p->desc->timings;
+	bool lp = p->desc->mode_flags & MIPI_DSI_MODE_LPM;
+	struct st7703_test_host *th = test->priv;
+	struct st7703 *ctx = st7703_test_probe(test, p->desc, NULL);
+	unsigned int n;
+
+	/* Probe leaves the panel alone */
+	KUNIT_EXPECT_EQ(test, th->num_msgs, 0U);
+	KUNIT_EXPECT_FALSE(test, th->vcc.on);
+	KUNIT_EXPECT_EQ(test, th->resets, 0U);
+	KUNIT_EXPECT_EQ(test, ctx->power_state, ST7703_POWER_OFF);
+	KUNIT_EXPECT_EQ(test, th->dsi->lanes, p->desc->lanes);
+	KUNIT_EXPECT_EQ(test, th->dsi->format, p->desc->format);
+
+	st7703_test_step(test, ctx, st7703_prepare, ST7703_PHASE_PREPARE);
+	KUNIT_EXPECT_TRUE(test, th->vcc.on);
+	KUNIT_EXPECT_TRUE(test, th->iovcc.on);
+	KUNIT_EXPECT_EQ(test, th->resets, 1U);
+	n = st7703_test_expect_seq(test, ctx, 0, lp);
+	KUNIT_EXPECT_EQ(test, th->num_msgs, n);
+	KUNIT_EXPECT_EQ(test, th->bytes, p->init_bytes);
+	KUNIT_EXPECT_GE(test, (s64)st7703_test_last_us(ctx, ST7703_PHASE_RESET),
+			(s64)t->reset * USEC_PER_MSEC);
+	KUNIT_EXPECT_GE(test, (s64)st7703_test_last_us(ctx, ST7703_PHASE_INIT),
+			(s64)st7703_test_seq_delay(p->desc->init_seq) * USEC_PER_MSEC);
+	KUNIT_EXPECT_EQ(test, ctx->power_state, ST7703_POWER_ON);
+
+	/* The DCS backlight is switched on together with the display */
+	st7703_test_step(test, ctx, st7703_enable, ST7703_PHASE_ENABLE);
+	KUNIT_ASSERT_EQ(test, th->num_msgs, n + 4);
+	st7703_test_expect_cmd(test, n, MIPI_DCS_EXIT_SLEEP_MODE);
+	st7703_test_expect_param(test, n + 1, MIPI_DCS_WRITE_CONTROL_DISPLAY,
+				 ST7703_CTRL_BCTRL | ST7703_CTRL_DD | ST7703_CTRL_BL);
+	st7703_test_expect_param(test, n + 2, MIPI_DCS_SET_DISPLAY_BRIGHTNESS,
+				 ctx->dcs_bl->props.brightness);
+	st7703_test_expect_cmd(test, n + 3, MIPI_DCS_SET_DISPLAY_ON);
+	KUNIT_EXPECT_GE(test, ktime_us_delta(th->msgs[n + 1].time, th->msgs[n].time),
+			(s64)t->sleep_out * USEC_PER_MSEC);
+	KUNIT_EXPECT_GE(test, (s64)st7703_test_last_us(ctx, ST7703_PHASE_ENABLE),
+			(s64)(t->sleep_out + t->display_on) * USEC_PER_MSEC);
+	KUNIT_EXPECT_EQ(test, ctx->power_state, ST7703_POWER_ENABLED);
+	n += 4;
+
+	st7703_test_step(test, ctx, st7703_disable, ST7703_PHASE_DISABLE);
+	KUNIT_ASSERT_EQ(test, th->num_msgs, n + 1);
+	st7703_test_expect_cmd(test, n, MIPI_DCS_SET_DISPLAY_OFF);
+	KUNIT_EXPECT_GE(test, (s64)st7703_test_last_us(ctx, ST7703_PHASE_DISABLE),
+			(s64)t->display_off * USEC_PER_MSEC);
+	n++;
+
+	st7703_test_step(test, ctx, st7703_unprepare, ST7703_PHASE_UNPREPARE);
+	KUNIT_ASSERT_EQ(test, th->num_msgs, n + 1);
+	st7703_test_expect_cmd(test, n, MIPI_DCS_ENTER_SLEEP_MODE);
+	KUNIT_EXPECT_GE(test, (s64)st7703_test_last_us(ctx, ST7703_PHASE_UNPREPARE),
+			(s64)t->sleep_in * USEC_PER_MSEC);
+	KUNIT_EXPECT_FALSE(test, th->vcc.on);
+	KUNIT_EXPECT_FALSE(test, th->iovcc.on);
+	/* Held in reset while the supplies are off */
+	KUNIT_EXPECT_EQ(test, th->reset_val, 0);
+	KUNIT_EXPECT_EQ(test, ctx->power_state, ST7703_POWER_OFF);
+
+	/* The next prepare starts over */
+	n = th->num_msgs;
+	st7703_test_step(test, ctx, st7703_prepare, ST7703_PHASE_PREPARE);
+	KUNIT_EXPECT_EQ(test, th->vcc.enables, 2U);
+	KUNIT_EXPECT_EQ(test, th->resets, 2U);
+	KUNIT_EXPECT_EQ(test, st7703_test_expect_seq(test, ctx, n, lp), th->num_msgs);
+}
+
+static const struct st7703_test_prop st7703_test_light_sleep_props[] = {
+	ST7703_TEST_BOOL("sitronix,light-sleep"),
+	{}
+};
+
+static void st7703_test_light_sleep(struct kunit *test)
+{
+	struct st7703_test_host *th = test->priv;
+	struct st7703 *ctx = st7703_test_probe(test, &gx040hd_desc,
+					       st7703_test_light_sleep_props);
+	unsigned int n;
+
+	st7703_test_step(test, ctx, st7703_prepare, ST7703_PHASE_PREPARE);
+	st7703_test_step(test, ctx, st7703_enable, ST7703_PHASE_ENABLE);
+	st7703_test_step(test, ctx, st7703_disable, ST7703_PHASE_DISABLE);
+	st7703_test_step(test, ctx, st7703_unprepare, ST7703_PHASE_UNPREPARE);
+	KUNIT_EXPECT_EQ(test, ctx->power_state, ST7703_POWER_SLEEP);
+	KUNIT_EXPECT_TRUE(test, th->vcc.on);
+	KUNIT_EXPECT_EQ(test, th->resets, 1U);
+
+	/* SETEXTC still reads back, so only sleep-out is left for enable */
+	n = th->num_msgs;
+	st7703_test_step(test, ctx, st7703_prepare, ST7703_PHASE_PREPARE);
+	KUNIT_EXPECT_EQ(test, th->num_msgs, n);
+	KUNIT_EXPECT_GT(test, th->reads, 0U);
+	KUNIT_EXPECT_EQ(test, th->resets, 1U);
+	KUNIT_EXPECT_EQ(test, th->vcc.enables, 1U);
+	KUNIT_EXPECT_EQ(test, ctx->power_state, ST7703_POWER_ON);
+
+	/* A controller that lost its registers while asleep is initialized */
+	st7703_test_step(test, ctx, st7703_unprepare, ST7703_PHASE_UNPREPARE);
+	memset(th->reg_len, 0, sizeof(th->reg_len));
+	n = th->num_msgs;
+	st7703_test_step(test, ctx, st7703_prepare, ST7703_PHASE_PREPARE);
+	KUNIT_EXPECT_EQ(test, th->resets, 2U);
+	KUNIT_EXPECT_EQ(test, st7703_test_expect_seq(test, ctx, n, true),
+			th->num_msgs);
+	KUNIT_EXPECT_EQ(test, th->vcc.enables, 1U);
+}
+
+static void st7703_test_sleep_in_gap(struct kunit *test)
+{
+	struct st7703_test_host *th = test->priv;
+	struct st7703 *ctx = st7703_test_probe(test, &gx040hd_desc, NULL);
+	ktime_t sleep_in;
+	unsigned int n;
+
+	st7703_test_step(test, ctx, st7703_prepare, ST7703_PHASE_PREPARE);
+	n = th->num_msgs;
+
+	/* As if a polled sleep-in had just been confirmed */
+	sleep_in = ktime_get();
+	ctx->sleep_in_time = sleep_in;
+
+	st7703_test_step(test, ctx, st7703_enable, ST7703_PHASE_ENABLE);
+	st7703_test_expect_cmd(test, n, MIPI_DCS_EXIT_SLEEP_MODE);
+	KUNIT_EXPECT_GE(test, ktime_ms_delta(th->msgs[n].time, sleep_in),
+			(s64)ST7703_SLEEP_IN_OUT_MS);
+}
+
+static void st7703_test_xbd599_patch(struct kunit *test)
+{
+	static const u8 cos_map[] = { 0x00, 0x00, 0x00, 0x01, 0x00, 0x00 };
+	const u8 *gip1 = st7703_find_cmd(gx040hd_init_seq, ST7703_CMD_SETGIP1);
+	struct st7703_test_host *th = test->priv;
+	struct st7703 *ctx = st7703_test_probe(test, &xbd599_desc, NULL);
+	const struct st7703_test_msg *m = NULL;
+	unsigned int i;
+
+	st7703_test_step(test, ctx, st7703_prepare, ST7703_PHASE_PREPARE);
+
+	for (i = 0; i < th->num_msgs; i++)
+		if (th->msgs[i].buf[0] == ST7703_CMD_SETGIP1)
+			m = &th->msgs[i];
+	KUNIT_ASSERT_NOT_NULL(test, m);
+	KUNIT_ASSERT_NOT_NULL(test, gip1);
+	KUNIT_ASSERT_EQ(test, m->len, (size_t)gip1[1]);
+
+	/* Only parameters 50 to 55 differ from the GX040HD */
+	KUNIT_EXPECT_MEMEQ(test, &m->buf[1 + 50], cos_map, sizeof(cos_map));
+	KUNIT_EXPECT_MEMEQ(test, m->buf, &gip1[2], 1 + 50);
+	KUNIT_EXPECT_MEMEQ(test, &m->buf[1 + 50 + sizeof(cos_map)],
+			   &gip1[2 + 1 + 50 + sizeof(cos_map)],
+			   m->len - 1 - 50 - sizeof(cos_map));
+}
+
+static const struct st7703_test_prop st7703_test_rgb565_props[] = {
+	ST7703_TEST_STR("sitronix,pixel-format", "rgb565"),
+	{}
+};
+
+static void st7703_test_rgb565(struct kunit *test)
+{
+	struct st7703_test_host *th = test->priv;
+	struct st7703 *ctx = st7703_test_probe(test, &gx040hd_desc,
+					       st7703_test_rgb565_props);
+	unsigned int n;
+
+	KUNIT_EXPECT_EQ(test, th->dsi->format, MIPI_DSI_FMT_RGB565);
+
+	st7703_test_step(test, ctx, st7703_prepare, ST7703_PHASE_PREPARE);
+	n = st7703_test_expect_seq(test, ctx, 0, true);
+	KUNIT_ASSERT_EQ(test, th->num_msgs, n + 1);
+
+	/* COLMOD follows the init sequence */
+	st7703_test_expect_param(test, n, MIPI_DCS_SET_PIXEL_FORMAT,
+				 MIPI_DCS_PIXEL_FMT_16BIT << 4 |
+				 MIPI_DCS_PIXEL_FMT_16BIT);
+}
+
+static const struct st7703_test_prop st7703_test_flip_props[] = {
+	ST7703_TEST_BOOL("sitronix,flip-horizontal"),
+	ST7703_TEST_BOOL("sitronix,flip-vertical"),
+	ST7703_TEST_BOOL("sitronix,keep-boot-on"),
+	{}
+};
+
+static void st7703_test_flip(struct kunit *test)
+{
+	const u8 *panel = st7703_find_cmd(gx040hd_init_seq, ST7703_CMD_SETPANEL);
+	struct st7703_test_host *th = test->priv;
+	struct st7703 *ctx = st7703_test_probe(test, &gx040hd_desc,
+					       st7703_test_flip_props);
+
+	/* Firmware did not set up the flipped scan, so it is not taken over */
+	KUNIT_EXPECT_FALSE(test, ctx->keep_boot_on);
+
+	st7703_test_step(test, ctx, st7703_prepare, ST7703_PHASE_PREPARE);
+	KUNIT_EXPECT_EQ(test, st7703_test_expect_seq(test, ctx, 0, true),
+			th->num_msgs);
+	KUNIT_ASSERT_NOT_NULL(test, panel);
+	KUNIT_EXPECT_EQ(test, th->reg_len[ST7703_CMD_SETPANEL], 1);
+	KUNIT_EXPECT_EQ(test, th->regs[ST7703_CMD_SETPANEL][0],
+			panel[3] ^ (ST7703_PANEL_SS | ST7703_PANEL_BGR |
+				    ST7703_PANEL_GS));
+}
+
+static const struct st7703_test_prop st7703_test_auto_lanes_props[] = {
+	ST7703_TEST_BOOL("sitronix,auto-lanes"),
+	{}
+};
+
+static void st7703_test_auto_lanes(struct kunit *test)
+{
+	const u8 *mipi = st7703_find_cmd(gx040hd_init_seq, ST7703_CMD_SETMIPI);
+	struct st7703_test_host *th = test->priv;
+	struct st7703 *ctx = st7703_test_probe(test, &gx040hd_desc,
+					       st7703_test_auto_lanes_props);
+
+	/* 60Hz at 24bpp needs 994 Mbps, two lanes at 80% of 1 Gbps */
+	KUNIT_EXPECT_EQ(test, th->dsi->lanes, 2U);
+	KUNIT_EXPECT_EQ(test, th->dsi->hs_rate, ST7703_LANE_MAX_KBPS * 1000UL);
+
+	st7703_test_step(test, ctx, st7703_prepare, ST7703_PHASE_PREPARE);
+	KUNIT_EXPECT_EQ(test, st7703_test_expect_seq(test, ctx, 0, true),
+			th->num_msgs);
+	KUNIT_ASSERT_NOT_NULL(test, mipi);
+	KUNIT_EXPECT_EQ(test, th->regs[ST7703_CMD_SETMIPI][0],
+			(mipi[3] & ~ST7703_MIPI_LANES) | (2 - 1));
+}
+
+static const struct st7703_test_prop st7703_test_hs_props[] = {
+	ST7703_TEST_BOOL("sitronix,hs-commands"),
+	{}
+};
+
+static void st7703_test_hs_commands(struct kunit *test)
+{
+	struct st7703_test_host *th = test->priv;
+	struct st7703 *ctx = st7703_test_probe(test, &gx040hd_desc,
+					       st7703_test_hs_props);
+	unsigned int n;
+
+	st7703_test_step(test, ctx, st7703_prepare, ST7703_PHASE_PREPARE);
+	n = st7703_test_expect_seq(test, ctx, 0, false);
+	KUNIT_EXPECT_EQ(test, th->num_msgs, n);
+	KUNIT_EXPECT_TRUE(test, ctx->hs_cmds);
+
+	/* Video mode keeps its LPM flag, only the command groups use HS */
+	KUNIT_EXPECT_TRUE(test, th->dsi->mode_flags & MIPI_DSI_MODE_LPM);
+}
+
+static void st7703_test_hs_fallback(struct kunit *test)
+{
+	struct st7703_test_host *th = test->priv;
+	struct st7703 *ctx = st7703_test_probe(test, &gx040hd_desc,
+					       st7703_test_hs_props);
+	unsigned int n;
+
+	th->fail_hs = true;
+
+	st7703_test_step(test, ctx, st7703_prepare, ST7703_PHASE_PREPARE);
+	KUNIT_EXPECT_FALSE(test, ctx->hs_cmds);
+
+	/* The LP retry resends the whole group, starting from a fresh reset */
+	n = st7703_test_expect_seq(test, ctx, 0, true);
+	KUNIT_EXPECT_EQ(test, th->num_msgs, n);
+	KUNIT_EXPECT_EQ(test, th->resets, 2U);
+	KUNIT_EXPECT_EQ(test, ctx->power_state, ST7703_POWER_ON);
+}
+
+static struct kunit_case st7703_test_cases[] = {
+	KUNIT_CASE_PARAM(st7703_test_power_cycle, st7703_test_panels_gen_params),
+	KUNIT_CASE(st7703_test_light_sleep),
+	KUNIT_CASE(st7703_test_sleep_in_gap),
+	KUNIT_CASE(st7703_test_xbd599_patch),
+	KUNIT_CASE(st7703_test_rgb565),
+	KUNIT_CASE(st7703_test_flip),
+	KUNIT_CASE(st7703_test_auto_lanes),
+	KUNIT_CASE(st7703_test_hs_commands),
+	KUNIT_CASE(st7703_test_hs_fallback),
+	{}
+};
+
+static struct kunit_suite st7703_test_suite = {
+	.name = "panel-sitronix-st7703",
+	.init = st7703_test_init,
+	.exit = st7703_test_exit,
+	.test_cases = st7703_test_cases,
+};
+kunit_test_suite(st7703_test_suite);
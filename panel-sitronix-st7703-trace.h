@@ -0,0 +1,69 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * Tracepoints for the Sitronix ST7703 panel driver
+ */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM st7703
+
+#if !defined(_PANEL_SITRONIX_ST7703_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _PANEL_SITRONIX_ST7703_TRACE_H
+
+#include <linux/device.h>
+#include <linux/tracepoint.h>
+
+TRACE_EVENT(st7703_phase,
+	TP_PROTO(const struct device *dev, const char *phase, s64 duration_us,
+		 int err),
+	TP_ARGS(dev, phase, duration_us, err),
+
+	TP_STRUCT__entry(
+		__string(dev, dev_name(dev))
+		__string(phase, phase)
+		__field(s64, duration_us)
+		__field(int, err)
+	),
+
+	TP_fast_assign(
+		__assign_str(dev);
+		__assign_str(phase);
+		__entry->duration_us = duration_us;
+		__entry->err = err;
+	),
+
+	TP_printk("%s %s: %lld us err=%d", __get_str(dev), __get_str(phase),
+		  __entry->duration_us, __entry->err)
+);
+
+TRACE_EVENT(st7703_cmd,
+	TP_PROTO(const struct device *dev, u8 cmd, u8 len, s64 duration_us,
+		 int err),
+	TP_ARGS(dev, cmd, len, duration_us, err),
+
+	TP_STRUCT__entry(
+		__string(dev, dev_name(dev))
+		__field(u8, cmd)
+		__field(u8, len)
+		__field(s64, duration_us)
+		__field(int, err)
+	),
+
+	TP_fast_assign(
+		__assign_str(dev);
+		__entry->cmd = cmd;
+		__entry->len = len;
+		__entry->duration_us = duration_us;
+		__entry->err = err;
+	),
+
+	TP_printk("%s cmd=0x%02x len=%u: %lld us err=%d", __get_str(dev),
+		  __entry->cmd, __entry->len, __entry->duration_us, __entry->err)
+);
+
+#endif /* _PANEL_SITRONIX_ST7703_TRACE_H */
+
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE panel-sitronix-st7703-trace
+#include <trace/define_trace.h>
@@ -0,0 +1,515 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * KMS level display latency benchmark for the GX040HD panel.
+ *
+ * For every mode of the connector it measures, using atomic commits:
+ *
+ * - DPMS off -> on: from the ACTIVE=1 commit to its first flip event
+ * - commit to vblank: from a page flip commit to its flip event
+ * - vblank interval and its jitter, from consecutive flip events
+ * - page flip throughput
+ *
+ * Results are printed as one JSON object per mode. Any KMS driver with
+ * atomic support works, so the tool also runs against vkms on machines
+ * without a panel. It needs DRM master, so stop the compositor first.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <math.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <drm_fourcc.h>
+#include <xf86drm.h>
+#include <xf86drmMode.h>
+
+#define DEFAULT_FLIPS	120
+#define DEFAULT_DPMS	5
+#define EVENT_TIMEOUT_MS 1000
+
+struct stats {
+	double min, max, sum, sum_sq;
+	unsigned int n;
+};
+
+struct buffer {
+	uint32_t handle, fb_id;
+};
+
+struct bench {
+	int fd;
+	uint32_t conn_id, crtc_id, plane_id;
+	uint32_t conn_crtc_prop;
+	uint32_t crtc_mode_prop, crtc_active_prop;
+	uint32_t plane_fb_prop, plane_crtc_prop;
+	uint32_t plane_src_x_prop, plane_src_y_prop, plane_src_w_prop, plane_src_h_prop;
+	uint32_t plane_crtc_x_prop, plane_crtc_y_prop, plane_crtc_w_prop, plane_crtc_h_prop;
+	struct buffer buf[2];
+	/* Timestamp of the last flip event, in us on CLOCK_MONOTONIC */
+	double event_us;
+	bool event_done;
+};
+
+static double now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static void stats_add(struct stats *s, double v)
+{
+	if (!s->n || v < s->min)
+		s->min = v;
+	if (!s->n || v > s->max)
+		s->max = v;
+	s->sum += v;
+	s->sum_sq += v * v;
+	s->n++;
+}
+
+static double stats_avg(const struct stats *s)
+{
+	return s->n ? s->sum / s->n : 0;
+}
+
+static double stats_stddev(const struct stats *s)
+{
+	double avg = stats_avg(s);
+
+	return s->n ? sqrt(fmax(s->sum_sq / s->n - avg * avg, 0)) : 0;
+}
+
+static void stats_print(const char *name, const struct stats *s)
+{
+	printf("\"%s\":{\"n\":%u,\"min\":%.1f,\"avg\":%.1f,\"max\":%.1f,\"stddev\":%.1f}",
+	       name, s->n, s->min, stats_avg(s), s->max, stats_stddev(s));
+}
+
+static uint32_t find_prop(int fd, uint32_t obj_id, uint32_t obj_type,
+			  const char *name)
+{
+	drmModeObjectProperties *props;
+	drmModePropertyRes *prop;
+	uint32_t id = 0, i;
+
+	props = drmModeObjectGetProperties(fd, obj_id, obj_type);
+	if (!props)
+		return 0;
+
+	for (i = 0; i < props->count_props && !id; i++) {
+		prop = drmModeGetProperty(fd, props->props[i]);
+		if (!prop)
+			continue;
+		if (!strcmp(prop->name, name))
+			id = prop->prop_id;
+		drmModeFreeProperty(prop);
+	}
+	drmModeFreeObjectProperties(props);
+
+	if (!id)
+		fprintf(stderr, "Property %s not found on object %u\n", name, obj_id);
+	return id;
+}
+
+static bool plane_is_primary(int fd, uint32_t plane_id)
+{
+	drmModeObjectProperties *props;
+	drmModePropertyRes *prop;
+	bool primary = false;
+	uint32_t i;
+
+	props = drmModeObjectGetProperties(fd, plane_id, DRM_MODE_OBJECT_PLANE);
+	if (!props)
+		return false;
+
+	for (i = 0; i < props->count_props; i++) {
+		prop = drmModeGetProperty(fd, props->props[i]);
+		if (!prop)
+			continue;
+		if (!strcmp(prop->name, "type"))
+			primary = props->prop_values[i] == DRM_PLANE_TYPE_PRIMARY;
+		drmModeFreeProperty(prop);
+	}
+	drmModeFreeObjectProperties(props);
+
+	return primary;
+}
+
+static int open_card(const char *path, const char *driver)
+{
+	char name[32];
+	drmVersion *ver;
+	int fd, i;
+
+	if (path)
+		return open(path, O_RDWR | O_CLOEXEC);
+
+	for (i = 0; i < 16; i++) {
+		snprintf(name, sizeof(name), "/dev/dri/card%d", i);
+		fd = open(name, O_RDWR | O_CLOEXEC);
+		if (fd < 0)
+			continue;
+
+		ver = drmGetVersion(fd);
+		if (ver && (!driver || !strcmp(ver->name, driver))) {
+			fprintf(stderr, "Using %s (%s)\n", name, ver->name);
+			drmFreeVersion(ver);
+			return fd;
+		}
+		drmFreeVersion(ver);
+		close(fd);
+	}
+
+	errno = ENODEV;
+	return -1;
+}
+
+static int setup_pipe(struct bench *b, uint32_t conn_id)
+{
+	drmModeRes *res = drmModeGetResources(b->fd);
+	drmModePlaneRes *planes;
+	drmModeConnector *conn = NULL;
+	drmModeEncoder *enc;
+	drmModePlane *plane;
+	uint32_t possible = 0;
+	int i, j, crtc_idx = -1;
+
+	if (!res)
+		return -errno;
+
+	for (i = 0; i < res->count_connectors && !conn; i++) {
+		conn = drmModeGetConnector(b->fd, res->connectors[i]);
+		if (conn && ((conn_id && conn->connector_id == conn_id) ||
+			     (!conn_id && conn->connection == DRM_MODE_CONNECTED &&
+			      conn->count_modes)))
+			break;
+		drmModeFreeConnector(conn);
+		conn = NULL;
+	}
+	if (!conn) {
+		fprintf(stderr, "No connected connector\n");
+		return -ENODEV;
+	}
+	b->conn_id = conn->connector_id;
+
+	for (i = 0; i < conn->count_encoders; i++) {
+		enc = drmModeGetEncoder(b->fd, conn->encoders[i]);
+		if (enc)
+			possible |= enc->possible_crtcs;
+		drmModeFreeEncoder(enc);
+	}
+	drmModeFreeConnector(conn);
+
+	for (i = 0; i < res->count_crtcs; i++) {
+		if (possible & (1u << i)) {
+			crtc_idx = i;
+			b->crtc_id = res->crtcs[i];
+			break;
+		}
+	}
+	drmModeFreeResources(res);
+	if (crtc_idx < 0)
+		return -ENODEV;
+
+	planes = drmModeGetPlaneResources(b->fd);
+	for (j = 0; planes && j < (int)planes->count_planes && !b->plane_id; j++) {
+		plane = drmModeGetPlane(b->fd, planes->planes[j]);
+		if (plane && (plane->possible_crtcs & (1u << crtc_idx)) &&
+		    plane_is_primary(b->fd, plane->plane_id))
+			b->plane_id = plane->plane_id;
+		drmModeFreePlane(plane);
+	}
+	drmModeFreePlaneResources(planes);
+	if (!b->plane_id)
+		return -ENODEV;
+
+	b->conn_crtc_prop = find_prop(b->fd, b->conn_id, DRM_MODE_OBJECT_CONNECTOR, "CRTC_ID");
+	b->crtc_mode_prop = find_prop(b->fd, b->crtc_id, DRM_MODE_OBJECT_CRTC, "MODE_ID");
+	b->crtc_active_prop = find_prop(b->fd, b->crtc_id, DRM_MODE_OBJECT_CRTC, "ACTIVE");
+	b->plane_fb_prop = find_prop(b->fd, b->plane_id, DRM_MODE_OBJECT_PLANE, "FB_ID");
+	b->plane_crtc_prop = find_prop(b->fd, b->plane_id, DRM_MODE_OBJECT_PLANE, "CRTC_ID");
+	b->plane_src_x_prop = find_prop(b->fd, b->plane_id, DRM_MODE_OBJECT_PLANE, "SRC_X");
+	b->plane_src_y_prop = find_prop(b->fd, b->plane_id, DRM_MODE_OBJECT_PLANE, "SRC_Y");
+	b->plane_src_w_prop = find_prop(b->fd, b->plane_id, DRM_MODE_OBJECT_PLANE, "SRC_W");
+	b->plane_src_h_prop = find_prop(b->fd, b->plane_id, DRM_MODE_OBJECT_PLANE, "SRC_H");
+	b->plane_crtc_x_prop = find_prop(b->fd, b->plane_id, DRM_MODE_OBJECT_PLANE, "CRTC_X");
+	b->plane_crtc_y_prop = find_prop(b->fd, b->plane_id, DRM_MODE_OBJECT_PLANE, "CRTC_Y");
+	b->plane_crtc_w_prop = find_prop(b->fd, b->plane_id, DRM_MODE_OBJECT_PLANE, "CRTC_W");
+	b->plane_crtc_h_prop = find_prop(b->fd, b->plane_id, DRM_MODE_OBJECT_PLANE, "CRTC_H");
+
+	return 0;
+}
+
+static int create_buffer(struct bench *b, struct buffer *buf,
+			 uint32_t width, uint32_t height)
+{
+	uint32_t handles[4] = { 0 }, pitches[4] = { 0 }, offsets[4] = { 0 };
+	uint32_t pitch;
+	uint64_t size;
+	int ret;
+
+	ret = drmModeCreateDumbBuffer(b->fd, width, height, 32, 0,
+				      &buf->handle, &pitch, &size);
+	if (ret)
+		return ret;
+
+	handles[0] = buf->handle;
+	pitches[0] = pitch;
+	return drmModeAddFB2(b->fd, width, height, DRM_FORMAT_XRGB8888,
+			     handles, pitches, offsets, &buf->fb_id, 0);
+}
+
+static void destroy_buffer(struct bench *b, struct buffer *buf)
+{
+	if (buf->fb_id)
+		drmModeRmFB(b->fd, buf->fb_id);
+	if (buf->handle)
+		drmModeDestroyDumbBuffer(b->fd, buf->handle);
+	memset(buf, 0, sizeof(*buf));
+}
+
+static void flip_handler(int fd, unsigned int seq, unsigned int tv_sec,
+			 unsigned int tv_usec, unsigned int crtc_id, void *data)
+{
+	struct bench *b = data;
+
+	b->event_us = tv_sec * 1e6 + tv_usec;
+	b->event_done = true;
+}
+
+static int wait_event(struct bench *b)
+{
+	drmEventContext ev = {
+		.version = 3,
+		.page_flip_handler2 = flip_handler,
+	};
+	struct pollfd pfd = { .fd = b->fd, .events = POLLIN };
+
+	while (!b->event_done) {
+		if (poll(&pfd, 1, EVENT_TIMEOUT_MS) <= 0)
+			return -ETIMEDOUT;
+		drmHandleEvent(b->fd, &ev);
+	}
+
+	return 0;
+}
+
+/* Commits and returns the time of the call, or a negative error */
+static double commit(struct bench *b, drmModeAtomicReq *req, uint32_t flags)
+{
+	double start;
+	int ret;
+
+	b->event_done = false;
+	start = now_us();
+	ret = drmModeAtomicCommit(b->fd, req, flags, b);
+	drmModeAtomicFree(req);
+
+	return ret ? ret : start;
+}
+
+static drmModeAtomicReq *pipe_req(struct bench *b, uint32_t mode_blob,
+				  const drmModeModeInfo *mode, uint32_t fb_id)
+{
+	drmModeAtomicReq *req = drmModeAtomicAlloc();
+
+	drmModeAtomicAddProperty(req, b->conn_id, b->conn_crtc_prop, b->crtc_id);
+	drmModeAtomicAddProperty(req, b->crtc_id, b->crtc_mode_prop, mode_blob);
+	drmModeAtomicAddProperty(req, b->crtc_id, b->crtc_active_prop, 1);
+	drmModeAtomicAddProperty(req, b->plane_id, b->plane_fb_prop, fb_id);
+	drmModeAtomicAddProperty(req, b->plane_id, b->plane_crtc_prop, b->crtc_id);
+	drmModeAtomicAddProperty(req, b->plane_id, b->plane_src_x_prop, 0);
+	drmModeAtomicAddProperty(req, b->plane_id, b->plane_src_y_prop, 0);
+	drmModeAtomicAddProperty(req, b->plane_id, b->plane_src_w_prop,
+				 (uint64_t)mode->hdisplay << 16);
+	drmModeAtomicAddProperty(req, b->plane_id, b->plane_src_h_prop,
+				 (uint64_t)mode->vdisplay << 16);
+	drmModeAtomicAddProperty(req, b->plane_id, b->plane_crtc_x_prop, 0);
+	drmModeAtomicAddProperty(req, b->plane_id, b->plane_crtc_y_prop, 0);
+	drmModeAtomicAddProperty(req, b->plane_id, b->plane_crtc_w_prop, mode->hdisplay);
+	drmModeAtomicAddProperty(req, b->plane_id, b->plane_crtc_h_prop, mode->vdisplay);
+
+	return req;
+}
+
+static drmModeAtomicReq *active_req(struct bench *b, bool active)
+{
+	drmModeAtomicReq *req = drmModeAtomicAlloc();
+
+	drmModeAtomicAddProperty(req, b->crtc_id, b->crtc_active_prop, active);
+	return req;
+}
+
+static drmModeAtomicReq *flip_req(struct bench *b, uint32_t fb_id)
+{
+	drmModeAtomicReq *req = drmModeAtomicAlloc();
+
+	drmModeAtomicAddProperty(req, b->plane_id, b->plane_fb_prop, fb_id);
+	return req;
+}
+
+static int bench_mode(struct bench *b, const drmModeModeInfo *mode,
+		      unsigned int flips, unsigned int dpms_cycles)
+{
+	const uint32_t event = DRM_MODE_PAGE_FLIP_EVENT | DRM_MODE_ATOMIC_NONBLOCK;
+	struct stats dpms = { 0 }, latency = { 0 }, interval = { 0 };
+	double start, first = 0, last = 0, modeset;
+	uint32_t blob;
+	unsigned int i;
+	int ret;
+
+	ret = create_buffer(b, &b->buf[0], mode->hdisplay, mode->vdisplay);
+	if (!ret)
+		ret = create_buffer(b, &b->buf[1], mode->hdisplay, mode->vdisplay);
+	if (!ret)
+		ret = drmModeCreatePropertyBlob(b->fd, mode, sizeof(*mode), &blob);
+	if (ret)
+		goto out;
+
+	start = commit(b, pipe_req(b, blob, mode, b->buf[0].fb_id),
+		       DRM_MODE_ATOMIC_ALLOW_MODESET);
+	if (start < 0) {
+		ret = start;
+		goto out_blob;
+	}
+	modeset = now_us() - start;
+
+	for (i = 0; i < dpms_cycles; i++) {
+		start = commit(b, active_req(b, false), DRM_MODE_ATOMIC_ALLOW_MODESET);
+		if (start < 0) {
+			ret = start;
+			goto out_blob;
+		}
+
+		start = commit(b, active_req(b, true),
+			       event | DRM_MODE_ATOMIC_ALLOW_MODESET);
+		ret = start < 0 ? start : wait_event(b);
+		if (ret)
+			goto out_blob;
+		stats_add(&dpms, b->event_us - start);
+	}
+
+	for (i = 0; i < flips; i++) {
+		start = commit(b, flip_req(b, b->buf[(i + 1) % 2].fb_id), event);
+		ret = start < 0 ? start : wait_event(b);
+		if (ret)
+			goto out_blob;
+
+		stats_add(&latency, b->event_us - start);
+		if (i)
+			stats_add(&interval, b->event_us - last);
+		else
+			first = b->event_us;
+		last = b->event_us;
+	}
+
+	printf("{\"mode\":\"%s\",\"clock_khz\":%u,\"vrefresh\":%u,\"modeset_us\":%.1f,",
+	       mode->name, mode->clock, mode->vrefresh, modeset);
+	stats_print("dpms_on_us", &dpms);
+	putchar(',');
+	stats_print("commit_to_vblank_us", &latency);
+	putchar(',');
+	stats_print("vblank_interval_us", &interval);
+	printf(",\"expected_interval_us\":%.1f,\"flips_per_sec\":%.2f}\n",
+	       1e3 * mode->htotal * mode->vtotal / mode->clock,
+	       last > first ? (flips - 1) * 1e6 / (last - first) : 0);
+	fflush(stdout);
+
+out_blob:
+	drmModeDestroyPropertyBlob(b->fd, blob);
+out:
+	destroy_buffer(b, &b->buf[0]);
+	destroy_buffer(b, &b->buf[1]);
+	if (ret)
+		fprintf(stderr, "Mode %s failed: %s\n", mode->name, strerror(-ret));
+	return ret;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"Usage: %s [-D device] [-M driver] [-c connector] [-n flips] [-d dpms cycles]\n"
+		"  -D  DRM device, default: first card with a matching driver\n"
+		"  -M  driver name, e.g. vc4 or vkms\n"
+		"  -c  connector id, default: first connected\n"
+		"  -n  page flips per mode (%d)\n"
+		"  -d  DPMS off/on cycles per mode (%d)\n",
+		prog, DEFAULT_FLIPS, DEFAULT_DPMS);
+}
+
+int main(int argc, char **argv)
+{
+	const char *device = NULL, *driver = NULL;
+	unsigned int flips = DEFAULT_FLIPS, dpms = DEFAULT_DPMS;
+	struct bench b = { 0 };
+	drmModeConnector *conn;
+	uint32_t conn_id = 0;
+	int opt, i, ret = 0;
+
+	while ((opt = getopt(argc, argv, "D:M:c:n:d:h")) != -1) {
+		switch (opt) {
+		case 'D':
+			device = optarg;
+			break;
+		case 'M':
+			driver = optarg;
+			break;
+		case 'c':
+			conn_id = strtoul(optarg, NULL, 0);
+			break;
+		case 'n':
+			flips = strtoul(optarg, NULL, 0);
+			break;
+		case 'd':
+			dpms = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : 2;
+		}
+	}
+	if (flips < 2) {
+		fprintf(stderr, "Need at least 2 flips per mode\n");
+		return 2;
+	}
+
+	b.fd = open_card(device, driver);
+	if (b.fd < 0) {
+		perror("Failed to open DRM device");
+		return 1;
+	}
+
+	if (drmSetClientCap(b.fd, DRM_CLIENT_CAP_UNIVERSAL_PLANES, 1) ||
+	    drmSetClientCap(b.fd, DRM_CLIENT_CAP_ATOMIC, 1)) {
+		fprintf(stderr, "Driver does not support atomic modesetting\n");
+		return 1;
+	}
+
+	ret = setup_pipe(&b, conn_id);
+	if (ret) {
+		fprintf(stderr, "Failed to find a display pipe: %s\n", strerror(-ret));
+		return 1;
+	}
+
+	conn = drmModeGetConnector(b.fd, b.conn_id);
+	if (!conn)
+		return 1;
+
+	for (i = 0; i < conn->count_modes; i++)
+		if (bench_mode(&b, &conn->modes[i], flips, dpms))
+			ret = 1;
+
+	drmModeFreeConnector(conn);
+	close(b.fd);
+	return ret;
+}
@@ -0,0 +1,415 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * KUnit tests for the FT6336U driver, included at the end of the driver by
+ * make kunit. The configure path runs against a regmap that records every
+ * write, with the DT properties given as a software node. The interrupt
+ * handler reads its touch data from the same regmap and reports to an
+ * unregistered input device, whose MT slots are then checked, also with the
+ * panel rotation applied.
+ */
+
+#include <kunit/device.h>
+#include <kunit/test.h>
+
+#define FT6336U_TEST_MAX_WRITES 8
+
+struct ft6336u_test {
+	struct device *dev;
+	struct regmap *regmap;
+	unsigned int regs[FT6336U_TEST_MAX_WRITES];
+	unsigned int vals[FT6336U_TEST_MAX_WRITES];
+	unsigned int num_writes;
+	/* Read from TD_STATUS on, as the controller returns it */
+	u8 data[1 + FT6336U_MAX_TOUCHES * FT6336U_POINT_LEN];
+};
+
+static int ft6336u_test_reg_write(void *context, unsigned int reg,
+				  unsigned int val)
+{
+	struct ft6336u_test *t = context;
+
+	if (t->num_writes == FT6336U_TEST_MAX_WRITES)
+		return -ENOSPC;
+
+	t->regs[t->num_writes] = reg;
+	t->vals[t->num_writes] = val;
+	t->num_writes++;
+
+	return 0;
+}
+
+static int ft6336u_test_reg_read(void *context, unsigned int reg,
+				 unsigned int *val)
+{
+	struct ft6336u_test *t = context;
+	unsigned int i = reg - FT6336U_REG_TD_STATUS;
+
+	*val = reg >= FT6336U_REG_TD_STATUS && i < sizeof(t->data) ? t->data[i] : 0;
+
+	return 0;
+}
+
+static const struct regmap_config ft6336u_test_regmap_config = {
+	.reg_bits = 8,
+	.val_bits = 8,
+	.max_register = 0xff,
+	.reg_write = ft6336u_test_reg_write,
+	.reg_read = ft6336u_test_reg_read,
+};
+
+static int ft6336u_test_init(struct kunit *test)
+{
+	struct ft6336u_test *t;
+
+	t = kunit_kzalloc(test, sizeof(*t), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, t);
+
+	t->dev = kunit_device_register(test, "ft6336u-test");
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, t->dev);
+
+	t->regmap = devm_regmap_init(t->dev, NULL, t, &ft6336u_test_regmap_config);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, t->regmap);
+
+	test->priv = t;
+	return 0;
+}
+
+/* Run the configure path with @props as the device's DT properties */
+static int ft6336u_test_configure(struct kunit *test,
+				  const struct property_entry *props)
+{
+	struct ft6336u_test *t = test->priv;
+
+	KUNIT_ASSERT_EQ(test, device_create_managed_software_node(t->dev, props,
+								   NULL), 0);
+
+	return ft6336u_configure(t->dev, t->regmap);
+}
+
+static void ft6336u_test_expect_write(struct kunit *test, unsigned int i,
+				      unsigned int reg, unsigned int val)
+{
+	struct ft6336u_test *t = test->priv;
+
+	KUNIT_ASSERT_LT(test, i, t->num_writes);
+	KUNIT_EXPECT_EQ(test, t->regs[i], reg);
+	KUNIT_EXPECT_EQ(test, t->vals[i], val);
+}
+
+static void ft6336u_test_defaults(struct kunit *test)
+{
+	static const struct property_entry props[] = { {} };
+	struct ft6336u_test *t = test->priv;
+
+	/* Without properties the controller keeps auto monitor mode */
+	KUNIT_EXPECT_EQ(test, ft6336u_test_configure(test, props), 0);
+	KUNIT_EXPECT_EQ(test, t->num_writes, 0U);
+}
+
+static void ft6336u_test_period_active(struct kunit *test)
+{
+	static const struct property_entry props[] = {
+		PROPERTY_ENTRY_U32("focaltech,period-active", 6),
+		{}
+	};
+	struct ft6336u_test *t = test->priv;
+
+	KUNIT_EXPECT_EQ(test, ft6336u_test_configure(test, props), 0);
+	KUNIT_ASSERT_EQ(test, t->num_writes, 1U);
+	ft6336u_test_expect_write(test, 0, FT6336U_REG_PERIOD_ACTIVE, 6);
+}
+
+static void ft6336u_test_monitor_mode(struct kunit *test)
+{
+	static const struct property_entry props[] = {
+		PROPERTY_ENTRY_BOOL("focaltech,monitor-mode"),
+		PROPERTY_ENTRY_U32("focaltech,monitor-timeout-s", 2),
+		PROPERTY_ENTRY_U32("focaltech,period-monitor", 40),
+		{}
+	};
+	struct ft6336u_test *t = test->priv;
+
+	KUNIT_EXPECT_EQ(test, ft6336u_test_configure(test, props), 0);
+	KUNIT_ASSERT_EQ(test, t->num_writes, 3U);
+	ft6336u_test_expect_write(test, 0, FT6336U_REG_CTRL, 1);
+	ft6336u_test_expect_write(test, 1, FT6336U_REG_MONITOR_TIMEOUT, 2);
+	ft6336u_test_expect_write(test, 2, FT6336U_REG_PERIOD_MONITOR, 40);
+}
+
+static void ft6336u_test_monitor_timing_only(struct kunit *test)
+{
+	static const struct property_entry props[] = {
+		PROPERTY_ENTRY_U32("focaltech,monitor-timeout-s", 5),
+		{}
+	};
+	struct ft6336u_test *t = test->priv;
+
+	/* Tunes the default monitor mode without touching the mode itself */
+	KUNIT_EXPECT_EQ(test, ft6336u_test_configure(test, props), 0);
+	KUNIT_ASSERT_EQ(test, t->num_writes, 1U);
+	ft6336u_test_expect_write(test, 0, FT6336U_REG_MONITOR_TIMEOUT, 5);
+}
+
+static void ft6336u_test_out_of_range(struct kunit *test)
+{
+	static const struct property_entry props[] = {
+		PROPERTY_ENTRY_U32("focaltech,period-active", 0x100),
+		{}
+	};
+	struct ft6336u_test *t = test->priv;
+
+	KUNIT_EXPECT_EQ(test, ft6336u_test_configure(test, props), -EINVAL);
+	KUNIT_EXPECT_EQ(test, t->num_writes, 0U);
+}
+
+/* A device with the input setup of probe, without the chip and the IRQ */
+static struct ft6336u *ft6336u_test_ts(struct kunit *test)
+{
+	struct ft6336u_test *t = test->priv;
+	struct ft6336u *ts;
+
+	ts = kunit_kzalloc(test, sizeof(*ts), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, ts);
+	ts->regmap = t->regmap;
+
+	ts->input = devm_input_allocate_device(t->dev);
+	KUNIT_ASSERT_NOT_NULL(test, ts->input);
+
+	input_set_abs_params(ts->input, ABS_MT_POSITION_X, 0, 0x0fff, 0, 0);
+	input_set_abs_params(ts->input, ABS_MT_POSITION_Y, 0, 0x0fff, 0, 0);
+	touchscreen_parse_properties(ts->input, true, &ts->prop);
+	KUNIT_ASSERT_EQ(test, input_mt_init_slots(ts->input, FT6336U_MAX_TOUCHES,
+						  INPUT_MT_DIRECT | INPUT_MT_DROP_UNUSED),
+			0);
+
+	return ts;
+}
+
+/* Fill in point record @i of the next burst read */
+static void ft6336u_test_point(struct kunit *test, unsigned int i,
+			       enum ft6336u_event event, unsigned int id,
+			       unsigned int x, unsigned int y)
+{
+	struct ft6336u_test *t = test->priv;
+	u8 *p = &t->data[1 + i * FT6336U_POINT_LEN];
+
+	p[0] = event << 6 | x >> 8;
+	p[1] = x & 0xff;
+	p[2] = id << 4 | y >> 8;
+	p[3] = y & 0xff;
+}
+
+/* Run the interrupt handler with @touches in TD_STATUS */
+static void ft6336u_test_irq(struct kunit *test, struct ft6336u *ts,
+			     u8 touches)
+{
+	struct ft6336u_test *t = test->priv;
+
+	t->data[0] = touches;
+	KUNIT_EXPECT_EQ(test, ft6336u_irq(0, ts), IRQ_HANDLED);
+}
+
+static void ft6336u_test_expect_slot(struct kunit *test, struct ft6336u *ts,
+				     unsigned int slot, int x, int y)
+{
+	const struct input_mt_slot *s = &ts->input->mt->slots[slot];
+
+	KUNIT_EXPECT_GE_MSG(test, input_mt_get_value(s, ABS_MT_TRACKING_ID), 0,
+			    "slot %u", slot);
+	KUNIT_EXPECT_EQ(test, input_mt_get_value(s, ABS_MT_POSITION_X), x);
+	KUNIT_EXPECT_EQ(test, input_mt_get_value(s, ABS_MT_POSITION_Y), y);
+}
+
+static void ft6336u_test_expect_released(struct kunit *test,
+					 struct ft6336u *ts, unsigned int slot)
+{
+	const struct input_mt_slot *s = &ts->input->mt->slots[slot];
+
+	KUNIT_EXPECT_LT_MSG(test, input_mt_get_value(s, ABS_MT_TRACKING_ID), 0,
+			    "slot %u", slot);
+}
+
+static void ft6336u_test_decode(struct kunit *test)
+{
+	struct ft6336u *ts = ft6336u_test_ts(test);
+
+	/* 12-bit coordinates split across the event and ID nibbles */
+	ft6336u_test_point(test, 0, FT6336U_EVENT_DOWN, 1, 0x123, 0x456);
+	ft6336u_test_point(test, 1, FT6336U_EVENT_CONTACT, 0, 0xabc, 0x0de);
+	ft6336u_test_irq(test, ts, 2);
+
+	ft6336u_test_expect_slot(test, ts, 0, 0xabc, 0x0de);
+	ft6336u_test_expect_slot(test, ts, 1, 0x123, 0x456);
+}
+
+static void ft6336u_test_touch_count(struct kunit *test)
+{
+	struct ft6336u *ts = ft6336u_test_ts(test);
+
+	/* Only two records are read, whatever TD_STATUS claims */
+	ft6336u_test_point(test, 0, FT6336U_EVENT_CONTACT, 0, 10, 20);
+	ft6336u_test_point(test, 1, FT6336U_EVENT_CONTACT, 1, 30, 40);
+	ft6336u_test_irq(test, ts, 0x0f);
+	ft6336u_test_expect_slot(test, ts, 0, 10, 20);
+	ft6336u_test_expect_slot(test, ts, 1, 30, 40);
+
+	/* Only the first record counts for a single touch */
+	ft6336u_test_irq(test, ts, 1);
+	ft6336u_test_expect_slot(test, ts, 0, 10, 20);
+	ft6336u_test_expect_released(test, ts, 1);
+}
+
+static void ft6336u_test_bad_id(struct kunit *test)
+{
+	struct ft6336u *ts = ft6336u_test_ts(test);
+
+	/* IDs without a slot are dropped, not folded onto another slot */
+	ft6336u_test_point(test, 0, FT6336U_EVENT_CONTACT, 2, 10, 20);
+	ft6336u_test_point(test, 1, FT6336U_EVENT_CONTACT, 15, 30, 40);
+	ft6336u_test_irq(test, ts, 2);
+
+	ft6336u_test_expect_released(test, ts, 0);
+	ft6336u_test_expect_released(test, ts, 1);
+}
+
+static void ft6336u_test_up_none(struct kunit *test)
+{
+	struct ft6336u *ts = ft6336u_test_ts(test);
+
+	ft6336u_test_point(test, 0, FT6336U_EVENT_DOWN, 0, 10, 20);
+	ft6336u_test_point(test, 1, FT6336U_EVENT_DOWN, 1, 30, 40);
+	ft6336u_test_irq(test, ts, 2);
+	ft6336u_test_expect_slot(test, ts, 0, 10, 20);
+	ft6336u_test_expect_slot(test, ts, 1, 30, 40);
+
+	/* Lifted and empty records release their slots */
+	ft6336u_test_point(test, 0, FT6336U_EVENT_UP, 0, 10, 20);
+	ft6336u_test_point(test, 1, FT6336U_EVENT_NONE, 1, 30, 40);
+	ft6336u_test_irq(test, ts, 2);
+	ft6336u_test_expect_released(test, ts, 0);
+	ft6336u_test_expect_released(test, ts, 1);
+}
+
+static void ft6336u_test_release(struct kunit *test)
+{
+	struct ft6336u *ts = ft6336u_test_ts(test);
+
+	ft6336u_test_point(test, 0, FT6336U_EVENT_DOWN, 1, 100, 200);
+	ft6336u_test_irq(test, ts, 1);
+	ft6336u_test_expect_slot(test, ts, 1, 100, 200);
+	ft6336u_test_expect_released(test, ts, 0);
+
+	/* The last finger lifted, TD_STATUS drops to 0 */
+	ft6336u_test_irq(test, ts, 0);
+	ft6336u_test_expect_released(test, ts, 1);
+}
+
+struct ft6336u_test_rotation {
+	enum drm_panel_orientation orientation;
+	bool swapped;
+};
+
+static const struct ft6336u_test_rotation ft6336u_test_rotations[] = {
+	{ DRM_MODE_PANEL_ORIENTATION_BOTTOM_UP, false },
+	{ DRM_MODE_PANEL_ORIENTATION_LEFT_UP, false },
+	{ DRM_MODE_PANEL_ORIENTATION_RIGHT_UP, false },
+	{ DRM_MODE_PANEL_ORIENTATION_BOTTOM_UP, true },
+	{ DRM_MODE_PANEL_ORIENTATION_LEFT_UP, true },
+	{ DRM_MODE_PANEL_ORIENTATION_RIGHT_UP, true },
+};
+
+static void ft6336u_test_rotation_desc(const struct ft6336u_test_rotation *r,
+				       char *desc)
+{
+	static const char * const names[] = {
+		[DRM_MODE_PANEL_ORIENTATION_BOTTOM_UP] = "bottom-up",
+		[DRM_MODE_PANEL_ORIENTATION_LEFT_UP] = "left-up",
+		[DRM_MODE_PANEL_ORIENTATION_RIGHT_UP] = "right-up",
+	};
+
+	snprintf(desc, KUNIT_PARAM_DESC_SIZE, "%s%s", names[r->orientation],
+		 r->swapped ? " swapped" : "");
+}
+
+KUNIT_ARRAY_PARAM(ft6336u_test_rotations, ft6336u_test_rotations,
+		  ft6336u_test_rotation_desc);
+
+/*
+ * A touch on a non-square sensor, with and without a swapped sensor, must
+ * land where the rotated panel shows that panel position.
+ */
+static void ft6336u_test_orientation(struct kunit *test)
+{
+	const struct ft6336u_test_rotation *r = test->param_value;
+	const struct property_entry props[] = {
+		PROPERTY_ENTRY_U32("touchscreen-size-x", 800),
+		PROPERTY_ENTRY_U32("touchscreen-size-y", 480),
+		r->swapped ? PROPERTY_ENTRY_BOOL("touchscreen-swapped-x-y") :
+			     (struct property_entry){},
+		{}
+	};
+	struct ft6336u_test *t = test->priv;
+	const int x = 100, y = 50;
+	int px, py, pw, ph;
+	int sx, sy, sw;
+	struct ft6336u *ts;
+
+	KUNIT_ASSERT_EQ(test, device_create_managed_software_node(t->dev, props,
+								   NULL), 0);
+	ts = ft6336u_test_ts(test);
+	KUNIT_ASSERT_EQ(test, ts->prop.swap_x_y, r->swapped);
+
+	/* Panel position and size, before the rotation */
+	px = r->swapped ? y : x;
+	py = r->swapped ? x : y;
+	pw = r->swapped ? 479 : 799;
+	ph = r->swapped ? 799 : 479;
+
+	switch (r->orientation) {
+	case DRM_MODE_PANEL_ORIENTATION_BOTTOM_UP:
+		sx = pw - px;
+		sy = ph - py;
+		sw = pw;
+		break;
+	case DRM_MODE_PANEL_ORIENTATION_LEFT_UP:
+		sx = ph - py;
+		sy = px;
+		sw = ph;
+		break;
+	default:
+		sx = py;
+		sy = pw - px;
+		sw = ph;
+		break;
+	}
+
+	ft6336u_apply_orientation(ts, r->orientation);
+	KUNIT_EXPECT_EQ(test, input_abs_get_max(ts->input, ABS_MT_POSITION_X), sw);
+
+	ft6336u_test_point(test, 0, FT6336U_EVENT_DOWN, 0, x, y);
+	ft6336u_test_irq(test, ts, 1);
+	ft6336u_test_expect_slot(test, ts, 0, sx, sy);
+}
+
+static struct kunit_case ft6336u_test_cases[] = {
+	KUNIT_CASE(ft6336u_test_defaults),
+	KUNIT_CASE(ft6336u_test_period_active),
+	KUNIT_CASE(ft6336u_test_monitor_mode),
+	KUNIT_CASE(ft6336u_test_monitor_timing_only),
+	KUNIT_CASE(ft6336u_test_out_of_range),
+	KUNIT_CASE(ft6336u_test_decode),
+	KUNIT_CASE(ft6336u_test_touch_count),
+	KUNIT_CASE(ft6336u_test_bad_id),
+	KUNIT_CASE(ft6336u_test_up_none),
+	KUNIT_CASE(ft6336u_test_release),
+	KUNIT_CASE_PARAM(ft6336u_test_orientation,
+			 ft6336u_test_rotations_gen_params),
+	{}
+};
+
+static struct kunit_suite ft6336u_test_suite = {
+	.name = "touchscreen-focaltech-ft6336u",
+	.init = ft6336u_test_init,
+	.test_cases = ft6336u_test_cases,
+};
+kunit_test_suite(ft6336u_test_suite);
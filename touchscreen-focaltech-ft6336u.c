@@ -0,0 +1,336 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Driver for the FocalTech FT6336U capacitive touch controller, as used on
+ * the GX040HD-30MB-A1 4.0" panel.
+ *
+ * Both touch points are read in a single burst I2C transfer per interrupt,
+ * and events carry the time of the hard interrupt rather than the time the
+ * threaded handler got to run. Coordinates follow the rotation of the panel
+ * the sensor is laminated on.
+ */
+
+#include <linux/delay.h>
+#include <linux/gpio/consumer.h>
+#include <linux/i2c.h>
+#include <linux/input.h>
+#include <linux/input/mt.h>
+#include <linux/input/touchscreen.h>
+#include <linux/interrupt.h>
+#include <linux/ktime.h>
+#include <linux/mod_devicetable.h>
+#include <linux/module.h>
+#include <linux/of.h>
+#include <linux/property.h>
+#include <linux/regmap.h>
+
+#include <drm/drm_connector.h>
+
+#define DRV_NAME "ft6336u"
+
+#define FT6336U_REG_TD_STATUS		0x02	/* number of touch points */
+#define FT6336U_REG_CTRL		0x86	/* 1 = monitor mode when idle */
+#define FT6336U_REG_MONITOR_TIMEOUT	0x87	/* seconds before monitor mode */
+#define FT6336U_REG_PERIOD_ACTIVE	0x88	/* active report period */
+#define FT6336U_REG_PERIOD_MONITOR	0x89	/* monitor scan period */
+#define FT6336U_REG_FIRMID		0xA6
+#define FT6336U_REG_CIPHER		0xA3
+
+#define FT6336U_MAX_TOUCHES		2
+#define FT6336U_POINT_LEN		6
+
+/* Point record layout */
+#define FT6336U_EVENT(p)		((p)[0] >> 6)
+#define FT6336U_X(p)			(((p)[0] & 0x0f) << 8 | (p)[1])
+#define FT6336U_ID(p)			((p)[2] >> 4)
+#define FT6336U_Y(p)			(((p)[2] & 0x0f) << 8 | (p)[3])
+
+enum ft6336u_event {
+	FT6336U_EVENT_DOWN,
+	FT6336U_EVENT_UP,
+	FT6336U_EVENT_CONTACT,
+	FT6336U_EVENT_NONE,
+};
+
+/* Reset timings from the FocalTech application note */
+#define FT6336U_RESET_MS		5
+#define FT6336U_BOOT_MS			300
+
+struct ft6336u {
+	struct i2c_client *client;
+	struct regmap *regmap;
+	struct input_dev *input;
+	struct gpio_desc *reset_gpio;
+	struct touchscreen_properties prop;
+	/* Time of the last hard interrupt, used to stamp its events */
+	ktime_t irq_time;
+};
+
+static const struct regmap_config ft6336u_regmap_config = {
+	.reg_bits = 8,
+	.val_bits = 8,
+	.max_register = 0xff,
+};
+
+static irqreturn_t ft6336u_hard_irq(int irq, void *data)
+{
+	struct ft6336u *ts = data;
+
+	ts->irq_time = ktime_get();
+
+	return IRQ_WAKE_THREAD;
+}
+
+static irqreturn_t ft6336u_irq(int irq, void *data)
+{
+	struct ft6336u *ts = data;
+	u8 buf[1 + FT6336U_MAX_TOUCHES * FT6336U_POINT_LEN];
+	unsigned int touches, i;
+	const u8 *p;
+	int ret;
+
+	/* TD_STATUS and both points: one write-address, read-13 transfer */
+	ret = regmap_bulk_read(ts->regmap, FT6336U_REG_TD_STATUS, buf, sizeof(buf));
+	if (ret) {
+		dev_err_ratelimited(&ts->client->dev, "Failed to read touch data: %d\n",
+				    ret);
+		return IRQ_HANDLED;
+	}
+
+	touches = min_t(unsigned int, buf[0] & 0x0f, FT6336U_MAX_TOUCHES);
+
+	input_set_timestamp(ts->input, ts->irq_time);
+
+	for (i = 0; i < touches; i++) {
+		p = &buf[1 + i * FT6336U_POINT_LEN];
+
+		if (FT6336U_EVENT(p) == FT6336U_EVENT_UP ||
+		    FT6336U_EVENT(p) == FT6336U_EVENT_NONE ||
+		    FT6336U_ID(p) >= FT6336U_MAX_TOUCHES)
+			continue;
+
+		input_mt_slot(ts->input, FT6336U_ID(p));
+		input_mt_report_slot_state(ts->input, MT_TOOL_FINGER, true);
+		touchscreen_report_pos(ts->input, &ts->prop,
+				       FT6336U_X(p), FT6336U_Y(p), true);
+	}
+
+	/* Slots not reported above are released */
+	input_mt_sync_frame(ts->input);
+	input_sync(ts->input);
+
+	return IRQ_HANDLED;
+}
+
+static int ft6336u_write_dt_reg(struct device *dev, struct regmap *regmap,
+				const char *prop, unsigned int reg)
+{
+	u32 val;
+	int ret;
+
+	if (device_property_read_u32(dev, prop, &val))
+		return 0;
+
+	if (val > 0xff)
+		return dev_err_probe(dev, -EINVAL, "%s out of range: %u\n", prop, val);
+
+	ret = regmap_write(regmap, reg, val);
+	if (ret)
+		return dev_err_probe(dev, ret, "Failed to write %s\n", prop);
+
+	return 0;
+}
+
+/* Registers without a DT property keep the controller's defaults */
+static int ft6336u_configure(struct device *dev, struct regmap *regmap)
+{
+	int ret;
+
+	ret = ft6336u_write_dt_reg(dev, regmap, "focaltech,period-active",
+				   FT6336U_REG_PERIOD_ACTIVE);
+	if (ret)
+		return ret;
+
+	/*
+	 * Monitor mode, a slow scan while idle, is the controller's default.
+	 * Only force it on, in case firmware has switched it off.
+	 */
+	if (device_property_read_bool(dev, "focaltech,monitor-mode")) {
+		ret = regmap_write(regmap, FT6336U_REG_CTRL, 1);
+		if (ret)
+			return dev_err_probe(dev, ret, "Failed to set monitor mode\n");
+	}
+
+	ret = ft6336u_write_dt_reg(dev, regmap, "focaltech,monitor-timeout-s",
+				   FT6336U_REG_MONITOR_TIMEOUT);
+	if (ret)
+		return ret;
+
+	return ft6336u_write_dt_reg(dev, regmap, "focaltech,period-monitor",
+				    FT6336U_REG_PERIOD_MONITOR);
+}
+
+/*
+ * Map panel coordinates to screen coordinates for a rotated panel, on top
+ * of the sensor to panel mapping given by the touchscreen-* properties.
+ */
+static void ft6336u_apply_orientation(struct ft6336u *ts,
+				      enum drm_panel_orientation orientation)
+{
+	struct touchscreen_properties *prop = &ts->prop;
+	bool invert_x = false, invert_y = false, swap_x_y = false;
+
+	switch (orientation) {
+	case DRM_MODE_PANEL_ORIENTATION_BOTTOM_UP:
+		invert_x = true;
+		invert_y = true;
+		break;
+	case DRM_MODE_PANEL_ORIENTATION_LEFT_UP:
+		invert_y = true;
+		swap_x_y = true;
+		break;
+	case DRM_MODE_PANEL_ORIENTATION_RIGHT_UP:
+		invert_x = true;
+		swap_x_y = true;
+		break;
+	default:
+		return;
+	}
+
+	/* Inversion happens before the swap, so a swapped sensor swaps them */
+	if (prop->swap_x_y)
+		swap(invert_x, invert_y);
+
+	prop->invert_x ^= invert_x;
+	prop->invert_y ^= invert_y;
+	if (swap_x_y) {
+		prop->swap_x_y = !prop->swap_x_y;
+		swap(ts->input->absinfo[ABS_MT_POSITION_X],
+		     ts->input->absinfo[ABS_MT_POSITION_Y]);
+	}
+}
+
+/* Follow the rotation of the panel linked through the "panel" property */
+static void ft6336u_follow_panel(struct ft6336u *ts)
+{
+	struct device *dev = &ts->client->dev;
+	struct touchscreen_properties *prop = &ts->prop;
+	enum drm_panel_orientation orientation;
+	struct device_node *panel;
+	int ret;
+
+	panel = of_parse_phandle(dev->of_node, "panel", 0);
+	if (!panel)
+		return;
+
+	ret = of_drm_get_panel_orientation(panel, &orientation);
+	of_node_put(panel);
+	if (ret) {
+		dev_warn(dev, "Failed to get panel orientation: %d\n", ret);
+		return;
+	}
+
+	ft6336u_apply_orientation(ts, orientation);
+
+	dev_dbg(dev, "Panel orientation %d: invert x %d, y %d, swap %d\n",
+		orientation, prop->invert_x, prop->invert_y, prop->swap_x_y);
+}
+
+static int ft6336u_probe(struct i2c_client *client)
+{
+	struct device *dev = &client->dev;
+	unsigned int cipher, firmware;
+	struct ft6336u *ts;
+	int ret;
+
+	if (!client->irq)
+		return dev_err_probe(dev, -EINVAL, "No interrupt\n");
+
+	ts = devm_kzalloc(dev, sizeof(*ts), GFP_KERNEL);
+	if (!ts)
+		return -ENOMEM;
+
+	ts->client = client;
+	i2c_set_clientdata(client, ts);
+
+	ts->regmap = devm_regmap_init_i2c(client, &ft6336u_regmap_config);
+	if (IS_ERR(ts->regmap))
+		return dev_err_probe(dev, PTR_ERR(ts->regmap), "Failed to init regmap\n");
+
+	ts->reset_gpio = devm_gpiod_get_optional(dev, "reset", GPIOD_OUT_HIGH);
+	if (IS_ERR(ts->reset_gpio))
+		return dev_err_probe(dev, PTR_ERR(ts->reset_gpio), "Failed to get reset gpio\n");
+
+	if (ts->reset_gpio) {
+		msleep(FT6336U_RESET_MS);
+		gpiod_set_value_cansleep(ts->reset_gpio, 0);
+		msleep(FT6336U_BOOT_MS);
+	}
+
+	ret = regmap_read(ts->regmap, FT6336U_REG_CIPHER, &cipher);
+	if (!ret)
+		ret = regmap_read(ts->regmap, FT6336U_REG_FIRMID, &firmware);
+	if (ret)
+		return dev_err_probe(dev, ret, "Failed to read chip id\n");
+
+	ret = ft6336u_configure(dev, ts->regmap);
+	if (ret)
+		return ret;
+
+	ts->input = devm_input_allocate_device(dev);
+	if (!ts->input)
+		return -ENOMEM;
+
+	ts->input->name = "FocalTech FT6336U Touchscreen";
+	ts->input->id.bustype = BUS_I2C;
+
+	input_set_abs_params(ts->input, ABS_MT_POSITION_X, 0, 0x0fff, 0, 0);
+	input_set_abs_params(ts->input, ABS_MT_POSITION_Y, 0, 0x0fff, 0, 0);
+	touchscreen_parse_properties(ts->input, true, &ts->prop);
+	ft6336u_follow_panel(ts);
+
+	ret = input_mt_init_slots(ts->input, FT6336U_MAX_TOUCHES,
+				  INPUT_MT_DIRECT | INPUT_MT_DROP_UNUSED);
+	if (ret)
+		return dev_err_probe(dev, ret, "Failed to init MT slots\n");
+
+	ret = devm_request_threaded_irq(dev, client->irq, ft6336u_hard_irq,
+					ft6336u_irq, IRQF_ONESHOT, DRV_NAME, ts);
+	if (ret)
+		return dev_err_probe(dev, ret, "Failed to request irq\n");
+
+	ret = input_register_device(ts->input);
+	if (ret)
+		return dev_err_probe(dev, ret, "Failed to register input device\n");
+
+	dev_info(dev, "FT6336U cipher %#x firmware %#x - ready\n", cipher, firmware);
+	return 0;
+}
+
+static const struct of_device_id ft6336u_of_match[] = {
+	{ .compatible = "focaltech,ft6336u" },
+	{ /* sentinel */ }
+};
+MODULE_DEVICE_TABLE(of, ft6336u_of_match);
+
+static const struct i2c_device_id ft6336u_id[] = {
+	{ DRV_NAME },
+	{ /* sentinel */ }
+};
+MODULE_DEVICE_TABLE(i2c, ft6336u_id);
+
+static struct i2c_driver ft6336u_driver = {
+	.probe = ft6336u_probe,
+	.id_table = ft6336u_id,
+	.driver = {
+		.name = DRV_NAME,
+		.of_match_table = ft6336u_of_match,
+	},
+};
+module_i2c_driver(ft6336u_driver);
+
+#ifdef FT6336U_KUNIT_TEST
+#include "touchscreen-focaltech-ft6336u-kunit.c"
+#endif
+
+MODULE_DESCRIPTION("FocalTech FT6336U touchscreen driver");
+MODULE_LICENSE("GPL v2");